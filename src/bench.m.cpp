@@ -0,0 +1,360 @@
+// Headless benchmark for the simulation. Runs levels for a fixed number of ticks with no
+// window or graphics context and prints one JSON object per level to stdout.
+//
+// usage: sandfall_bench [--ticks N] [--seed S] [--serial] [--merge-colliders] [--lazy-colliders] [level...]
+//
+// Each level is either the path to a save file or gen:WxH for a generated level that is
+// W by H chunks. With no levels given, every save*.bin in the working directory is run,
+// or a generated 8x8 level if there are none. After each run the collider static
+// pixel masks of the final state are built with both the kernel and the original per
+// pixel path, to compare them. Every heap allocation made through operator new is
+// counted, for the whole run and for its second half, once buffers should have grown.
+#include "common.hpp"
+#include "world.hpp"
+#include "context.hpp"
+#include "serialisation.hpp"
+#include "random.hpp"
+#include "thread_pool.hpp"
+#include "update_rigid_bodies.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <format>
+#include <new>
+#include <optional>
+#include <print>
+#include <string>
+#include <vector>
+
+// Counts every allocation made through operator new on every thread. The array and
+// nothrow forms forward to these by default, and nothing in the simulation uses the
+// over-aligned ones. Box2D is written in C and allocates with malloc, so is not counted.
+namespace {
+std::atomic<sand::i64> heap_allocations = 0;
+}
+
+auto operator new(std::size_t size) -> void*
+{
+    heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (auto* ptr = std::malloc(size == 0 ? 1 : size)) {
+        return ptr;
+    }
+    throw std::bad_alloc{};
+}
+
+auto operator delete(void* ptr) noexcept -> void
+{
+    std::free(ptr);
+}
+
+auto operator delete(void* ptr, std::size_t) noexcept -> void
+{
+    std::free(ptr);
+}
+
+namespace {
+
+struct options
+{
+    int                      ticks    = 1000;
+    sand::u64                seed     = 0;
+    bool                     parallel = true;
+    bool                     merge    = false;
+    bool                     lazy     = false;
+    std::vector<std::string> levels;
+};
+
+auto print_usage() -> void
+{
+    std::print(stderr, "usage: sandfall_bench [--ticks N] [--seed S] [--serial] [--merge-colliders] [--lazy-colliders] [save.bin | gen:WxH]...\n");
+}
+
+auto parse_options(int argc, char** argv) -> std::optional<options>
+{
+    auto opts = options{};
+    for (int i = 1; i < argc; ++i) {
+        const auto arg = std::string{argv[i]};
+        const auto has_value = i + 1 < argc;
+        if (arg == "--ticks" && has_value) {
+            opts.ticks = std::stoi(argv[++i]);
+        } else if (arg == "--seed" && has_value) {
+            opts.seed = std::stoull(argv[++i]);
+        } else if (arg == "--serial") {
+            opts.parallel = false;
+        } else if (arg == "--merge-colliders") {
+            opts.merge = true;
+        } else if (arg == "--lazy-colliders") {
+            opts.lazy = true;
+        } else if (arg.starts_with("--")) {
+            return std::nullopt;
+        } else {
+            opts.levels.push_back(arg);
+        }
+    }
+
+    if (opts.levels.empty()) {
+        for (const auto& entry : std::filesystem::directory_iterator{"."}) {
+            const auto name = entry.path().filename().string();
+            if (entry.is_regular_file() && name.starts_with("save") && name.ends_with(".bin")) {
+                opts.levels.push_back(name);
+            }
+        }
+        std::ranges::sort(opts.levels);
+    }
+    if (opts.levels.empty()) {
+        opts.levels.push_back("gen:8x8");
+    }
+    return opts;
+}
+
+auto fill_circle(sand::pixel_world& w, glm::ivec2 centre, int radius, auto&& make_pixel) -> void
+{
+    for (int y = -radius; y <= radius; ++y) {
+        for (int x = -radius; x <= radius; ++x) {
+            const auto pos = sand::pixel_pos::from_ivec2(centre + glm::ivec2{x, y});
+            if (x * x + y * y <= radius * radius && w.is_valid_pixel(pos)) {
+                w.set(pos, make_pixel());
+            }
+        }
+    }
+}
+
+// Fills a new level with a rough landscape: an uneven rock floor, a few rock ledges and
+// blobs of loose material and liquids above them that fall and settle while the
+// benchmark runs
+auto generate_level(sand::level& l, sand::u64 seed) -> void
+{
+    using sand::pixel;
+    auto& w = l.pixels;
+    auto rng = sand::random_engine{seed};
+
+    // The pixel constructors pick their colour variant from the thread's engine
+    sand::thread_random_engine().seed(seed);
+
+    const auto chunks_width = w.width_in_chunks();
+    const auto chunks_height = w.height_in_chunks();
+
+    const auto width = w.width_in_pixels();
+    const auto height = w.height_in_pixels();
+
+    auto floor = height - height / 8;
+    for (int x = 0; x != width; ++x) {
+        floor = std::clamp(floor + rng.range(-1, 1), height - height / 4, height - 4);
+        for (int y = floor; y != height; ++y) {
+            w.set({x, y}, pixel::rock());
+        }
+    }
+
+    const auto area_in_chunks = chunks_width * chunks_height;
+    for (int i = 0; i != area_in_chunks; ++i) {
+        const auto y = rng.range(height / 4, height / 2);
+        const auto x = rng.range(0, width - 1);
+        const auto length = rng.range(16, 48);
+        for (int dx = 0; dx != length && x + dx < width; ++dx) {
+            w.set({x + dx, y}, pixel::rock());
+            w.set({x + dx, y + 1}, pixel::rock());
+        }
+    }
+
+    const auto makers = std::array{
+        &pixel::sand, &pixel::dirt, &pixel::coal, &pixel::water, &pixel::oil, &pixel::gunpowder
+    };
+    for (int i = 0; i != 2 * area_in_chunks; ++i) {
+        const auto centre = glm::ivec2{rng.range(0, width - 1), rng.range(0, height / 2)};
+        const auto radius = rng.range(4, 16);
+        fill_circle(w, centre, radius, makers[rng.range(0, static_cast<int>(makers.size()) - 1)]);
+    }
+
+    l.spawn_point = {width / 2, height / 8};
+}
+
+// Returns the size in chunks if name is of the form gen:WxH
+auto parse_generated(const std::string& name) -> std::optional<glm::ivec2>
+{
+    auto size = glm::ivec2{};
+    if (std::sscanf(name.c_str(), "gen:%dx%d", &size.x, &size.y) != 2 || size.x <= 0 || size.y <= 0) {
+        return std::nullopt;
+    }
+    return size;
+}
+
+auto json_string(const std::string& s) -> std::string
+{
+    auto out = std::string{"\""};
+    for (const char c : s) {
+        if (c == '"' || c == '\\') out += '\\';
+        out += c;
+    }
+    return out + "\"";
+}
+
+struct static_mask_timings
+{
+    double per_pixel_us = 0.0;
+    double kernel_us    = 0.0;
+    bool   matches      = false;
+};
+
+// Times building the static pixel mask of every chunk with the vectorised kernel
+// against the original pixel by pixel version, in microseconds per chunk. The masks
+// are hashed, which both checks that they agree and keeps them from being optimised out.
+auto time_static_masks(const sand::pixel_world& w) -> static_mask_timings
+{
+    constexpr auto repeats = 20;
+    const auto time = [&](auto&& get_mask, sand::u64& hash) {
+        const auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i != repeats; ++i) {
+            for (sand::i32 cy = 0; cy != w.height_in_chunks(); ++cy) {
+                for (sand::i32 cx = 0; cx != w.width_in_chunks(); ++cx) {
+                    for (const auto row : get_mask(w, sand::chunk_pos{cx, cy}).rows) {
+                        hash = sand::mix_seed(hash, row);
+                    }
+                }
+            }
+        }
+        const auto chunks = repeats * w.width_in_chunks() * w.height_in_chunks();
+        return std::chrono::duration<double, std::micro>{std::chrono::steady_clock::now() - start}.count() / chunks;
+    };
+
+    auto per_pixel_hash = sand::u64{0};
+    auto kernel_hash = sand::u64{0};
+    auto timings = static_mask_timings{};
+    timings.per_pixel_us = time(sand::get_static_pixels_per_pixel, per_pixel_hash);
+    timings.kernel_us = time(sand::get_static_pixels, kernel_hash);
+    timings.matches = per_pixel_hash == kernel_hash;
+    return timings;
+}
+
+auto run(const std::string& name, sand::level& l, const options& opts) -> void
+{
+    l.pixels.set_seed(opts.seed);
+    l.pixels.set_parallel(opts.parallel);
+    l.physics.merge_sleeping_colliders = opts.merge;
+    l.physics.only_colliders_near_bodies = opts.lazy;
+    l.player = sand::add_player(l.entities, l.physics.world, l.spawn_point);
+
+    auto ctx = sand::context{};
+    auto totals = sand::update_timings{};
+    auto awake_total = 0.0;
+    auto awake_max = 0;
+    auto colliders_rebuilt = 0ll;
+    auto colliders_skipped = 0ll;
+    auto islands_rebuilt = 0ll;
+    auto colliders_dropped = 0ll;
+
+    // Allocations should level off once the scratch buffers have grown to fit, so the
+    // second half of the run is reported separately
+    const auto allocations_at_start = heap_allocations.load();
+    auto allocations_at_half = allocations_at_start;
+
+    const auto start = std::chrono::steady_clock::now();
+    for (int tick = 0; tick != opts.ticks; ++tick) {
+        if (tick == opts.ticks / 2) {
+            allocations_at_half = heap_allocations.load();
+        }
+        sand::level_on_update(l, ctx);
+
+        totals.pixel_step       += l.timings.pixel_step;
+        totals.physics_step     += l.timings.physics_step;
+        totals.collider_rebuild += l.timings.collider_rebuild;
+        totals.entity_update    += l.timings.entity_update;
+        colliders_rebuilt       += l.physics.colliders_rebuilt;
+        colliders_skipped       += l.physics.colliders_skipped;
+        islands_rebuilt         += l.physics.islands_rebuilt;
+        colliders_dropped       += l.physics.colliders_dropped;
+
+        auto awake = 0;
+        for (sand::i32 cy = 0; cy != l.pixels.height_in_chunks(); ++cy) {
+            for (sand::i32 cx = 0; cx != l.pixels.width_in_chunks(); ++cx) {
+                if (l.pixels[sand::chunk_pos{cx, cy}].should_step) ++awake;
+            }
+        }
+        awake_total += awake;
+        awake_max = std::max(awake_max, awake);
+    }
+    const auto seconds = std::chrono::duration<double>{std::chrono::steady_clock::now() - start}.count();
+    const auto allocations_at_end = heap_allocations.load();
+
+    const auto masks = time_static_masks(l.pixels);
+
+    const auto ticks = static_cast<double>(std::max(opts.ticks, 1));
+    const auto per_tick_ms = [&](double total) { return 1000.0 * total / ticks; };
+    std::print(
+        "{{\"level\": {}, \"width\": {}, \"height\": {}, \"chunks\": {}, \"ticks\": {}, "
+        "\"seed\": {}, \"parallel\": {}, \"threads\": {}, \"seconds\": {:.6f}, \"ticks_per_sec\": {:.3f}, "
+        "\"awake_chunks\": {{\"mean\": {:.3f}, \"max\": {}}}, "
+        "\"colliders\": {{\"merged\": {}, \"lazy\": {}, \"rebuilt\": {}, \"skipped\": {}, \"dropped\": {}, \"islands_rebuilt\": {}}}, "
+        "\"heap_allocations\": {{\"total\": {}, \"second_half\": {}}}, "
+        "\"phase_ms_per_tick\": {{\"pixel_step\": {:.6f}, \"physics_step\": {:.6f}, "
+        "\"collider_rebuild\": {:.6f}, \"entity_update\": {:.6f}}}, "
+        "\"static_mask_us_per_chunk\": {{\"per_pixel\": {:.3f}, \"kernel\": {:.3f}, \"matches\": {}}}}}\n",
+        json_string(name),
+        l.pixels.width_in_pixels(),
+        l.pixels.height_in_pixels(),
+        l.pixels.width_in_chunks() * l.pixels.height_in_chunks(),
+        opts.ticks,
+        opts.seed,
+        opts.parallel,
+        sand::global_thread_pool().size() + 1,
+        seconds,
+        opts.ticks / seconds,
+        awake_total / ticks,
+        awake_max,
+        opts.merge,
+        opts.lazy,
+        colliders_rebuilt,
+        colliders_skipped,
+        colliders_dropped,
+        islands_rebuilt,
+        allocations_at_end - allocations_at_start,
+        allocations_at_end - allocations_at_half,
+        per_tick_ms(totals.pixel_step),
+        per_tick_ms(totals.physics_step),
+        per_tick_ms(totals.collider_rebuild),
+        per_tick_ms(totals.entity_update),
+        masks.per_pixel_us,
+        masks.kernel_us,
+        masks.matches
+    );
+}
+
+}
+
+auto main(int argc, char** argv) -> int
+{
+    const auto opts = parse_options(argc, argv);
+    if (!opts) {
+        print_usage();
+        return 1;
+    }
+
+    // Levels are built in place as the physics world can't be moved safely
+    auto rc = 0;
+    for (const auto& name : opts->levels) {
+        if (name.starts_with("gen:")) {
+            const auto size = parse_generated(name);
+            if (!size) {
+                std::print(stderr, "invalid generated level '{}', expected gen:WxH\n", name);
+                rc = 1;
+                continue;
+            }
+            auto level = sand::new_level(size->x, size->y);
+            generate_level(level, opts->seed);
+            run(name, level, *opts);
+        }
+        else if (std::filesystem::exists(name)) {
+            auto level = sand::load_level(name);
+            run(name, level, *opts);
+        }
+        else {
+            std::print(stderr, "could not find level '{}'\n", name);
+            rc = 1;
+        }
+    }
+    return rc;
+}
@@ -202,7 +202,7 @@ inline apx::index_t to_index(const apx::entity entity)
     return apx::split(entity).first;
 }
 
-template <typename... Comps>
+template <typename... Components>
 class registry
 {
 public:
@@ -212,10 +212,10 @@ public:
     using predicate_t = std::function<bool(apx::entity)>;
 
     // A tuple of tag types for metaprogramming purposes
-    inline static constexpr std::tuple<apx::meta::tag<Comps>...> tags{};
+    inline static constexpr std::tuple<apx::meta::tag<Components>...> tags{};
 
 private:
-    using tuple_type = std::tuple<apx::sparse_set<Comps>...>;
+    using tuple_type = std::tuple<apx::sparse_set<Components>...>;
 
     apx::sparse_set<apx::entity>    d_entities;
     std::deque<apx::entity>         d_pool;
@@ -503,8 +503,8 @@ apx::entity copy(apx::entity entity, const apx::registry<Comps...>& src, apx::re
 {
     auto new_entity = dst.create();
     apx::meta::for_each(apx::registry<Comps...>::tags, [&]<typename T>(apx::meta::tag<T>) {
-        if (src.has<T>(entity)) {
-            dst.add<T>(new_entity, src.get<T>(entity));
+        if (src.template has<T>(entity)) {
+            dst.template add<T>(new_entity, src.template get<T>(entity));
         }
     });
     return new_entity;
@@ -0,0 +1,217 @@
+#include "circuit.hpp"
+#include "world.hpp"
+
+#include <array>
+#include <atomic>
+
+namespace sand {
+namespace {
+
+constexpr auto circuit_offsets = std::array{
+    glm::ivec2{1, 0},
+    glm::ivec2{-1, 0},
+    glm::ivec2{0, 1},
+    glm::ivec2{0, -1}
+};
+
+// How far a change can reach: the pixel the other side of a relay
+constexpr auto circuit_reach = 2;
+
+auto is_conductor(pixel_type type) -> bool
+{
+    return properties(type).power_type == pixel_power_type::conductor;
+}
+
+// Whether a pixel of type src, when live, powers a neighbouring pixel of type dst.
+// diode_out only takes power from diodes, and never through a relay, and diode_in
+// never takes power straight from diode_out.
+auto can_power(pixel_type src, pixel_type dst, bool via_relay) -> bool
+{
+    if (dst == pixel_type::diode_in && src == pixel_type::diode_out && !via_relay) {
+        return false;
+    }
+    if (dst == pixel_type::diode_out) {
+        return !via_relay && (src == pixel_type::diode_in || src == pixel_type::diode_out);
+    }
+    return true;
+}
+
+}
+
+circuit::circuit(i32 width, i32 height)
+    : d_net_ids(width * height, -1)
+    , d_changed((width / config::chunk_size) * (height / config::chunk_size), 1)
+    , d_width{width}
+    , d_height{height}
+{
+}
+
+auto circuit::mark_changed(std::size_t chunk) -> void
+{
+    std::atomic_ref{d_changed[chunk]}.store(1, std::memory_order_relaxed);
+}
+
+auto circuit::release_net(i32 id) -> void
+{
+    auto& n = d_nets[id];
+    for (const auto pos : n.pixels) {
+        net_id(pos) = -1;
+        d_seeds.push_back(pos);
+    }
+    n.pixels.clear();
+    n.sources.clear();
+    n.outputs.clear();
+    n.alive = false;
+    d_free_nets.push_back(id);
+}
+
+auto circuit::flood_net(const pixel_world& w, pixel_pos seed) -> void
+{
+    auto id = static_cast<i32>(d_nets.size());
+    if (!d_free_nets.empty()) {
+        id = d_free_nets.back();
+        d_free_nets.pop_back();
+    } else {
+        d_nets.emplace_back();
+    }
+
+    // Other nets can be released while flooding but none are added, so this stays put
+    auto& n = d_nets[id];
+    n.alive = true;
+    n.powered = false;
+    n.written = false;
+
+    d_stack.clear();
+    d_stack.push_back(seed);
+    net_id(seed) = id;
+    while (!d_stack.empty()) {
+        const auto curr = d_stack.back();
+        d_stack.pop_back();
+        n.pixels.push_back(curr);
+        const auto curr_type = w.type(curr);
+
+        for (const auto offset : circuit_offsets) {
+            auto next = curr + offset;
+            if (!w.is_valid_pixel(next)) continue;
+            const auto via_relay = w.type(next) == pixel_type::relay;
+            if (via_relay) {
+                next = next + offset;
+                if (!w.is_valid_pixel(next)) continue;
+            }
+
+            const auto next_type = w.type(next);
+            if (properties(next_type).power_type == pixel_power_type::source) {
+                if (can_power(next_type, curr_type, via_relay)) {
+                    n.sources.push_back(next);
+                }
+                continue;
+            }
+            if (!is_conductor(next_type)) continue;
+
+            const auto forwards = can_power(curr_type, next_type, via_relay);
+            const auto backwards = can_power(next_type, curr_type, via_relay);
+            if (forwards && backwards) {
+                // A neighbour still in a net from before was out of reach of the change
+                // but is joined to this one now, so its net is absorbed into this one
+                const auto other = net_id(next);
+                if (other != -1 && other != id) {
+                    release_net(other);
+                }
+                if (net_id(next) == -1) {
+                    net_id(next) = id;
+                    d_stack.push_back(next);
+                }
+            }
+            else if (forwards) {
+                n.outputs.push_back(next);
+            }
+        }
+    }
+}
+
+auto circuit::rebuild(const pixel_world& w) -> void
+{
+    d_seeds.clear();
+    const auto width_in_chunks = w.width_in_chunks();
+    for (std::size_t chunk = 0; chunk != d_changed.size(); ++chunk) {
+        if (!d_changed[chunk]) continue;
+        d_changed[chunk] = 0;
+
+        const auto top_left = glm::ivec2{
+            static_cast<i32>(chunk % width_in_chunks) * config::chunk_size,
+            static_cast<i32>(chunk / width_in_chunks) * config::chunk_size
+        };
+        const auto min = glm::max(top_left - circuit_reach, glm::ivec2{0, 0});
+        const auto max = glm::min(top_left + config::chunk_size - 1 + circuit_reach, glm::ivec2{d_width - 1, d_height - 1});
+        for (i32 y = min.y; y <= max.y; ++y) {
+            for (i32 x = min.x; x <= max.x; ++x) {
+                const auto id = net_id({x, y});
+                if (id != -1) {
+                    release_net(id);
+                } else if (is_circuit_type(w.type({x, y}))) {
+                    d_seeds.push_back({x, y});
+                }
+            }
+        }
+    }
+
+    // Flooding can release more nets, which add their pixels to the seeds
+    for (std::size_t i = 0; i != d_seeds.size(); ++i) {
+        const auto seed = d_seeds[i];
+        if (net_id(seed) == -1 && is_conductor(w.type(seed))) {
+            flood_net(w, seed);
+        }
+    }
+}
+
+auto circuit::evaluate(pixel_world& w) -> void
+{
+    d_reached.assign(d_nets.size(), false);
+    d_queue.clear();
+    for (std::size_t id = 0; id != d_nets.size(); ++id) {
+        const auto& n = d_nets[id];
+        if (!n.alive) continue;
+        for (const auto source : n.sources) {
+            if (is_active_power_source(w[source])) {
+                d_reached[id] = true;
+                d_queue.push_back(static_cast<i32>(id));
+                break;
+            }
+        }
+    }
+
+    for (std::size_t i = 0; i != d_queue.size(); ++i) {
+        for (const auto output : d_nets[d_queue[i]].outputs) {
+            const auto id = net_id(output);
+            if (id != -1 && !d_reached[id]) {
+                d_reached[id] = true;
+                d_queue.push_back(id);
+            }
+        }
+    }
+
+    for (std::size_t id = 0; id != d_nets.size(); ++id) {
+        auto& n = d_nets[id];
+        if (!n.alive || (n.written && n.powered == d_reached[id])) continue;
+        n.powered = d_reached[id];
+        n.written = true;
+
+        for (const auto pos : n.pixels) {
+            const auto& props = properties(w.type(pos));
+            const auto power = n.powered ? props.power_max : u8{0};
+            if (w.power(pos) == power) continue;
+            w.visit(pos, [&](pixel& p) { p.power = power; });
+            if (n.powered && props.explodes_on_power) {
+                w.explode(pos, explosion{.min_radius = 25.0f, .max_radius = 30.0f, .scorch = 10.0f});
+            }
+        }
+    }
+}
+
+auto circuit::update(pixel_world& w) -> void
+{
+    rebuild(w);
+    evaluate(w);
+}
+
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include "common.hpp"
+#include "pixel.hpp"
+
+#include <vector>
+
+namespace sand {
+
+class pixel_world;
+
+// Pixels that take part in circuits, whose placement changes the wiring
+inline auto is_circuit_type(pixel_type type) -> bool
+{
+    return properties(type).power_type != pixel_power_type::none || type == pixel_type::relay;
+}
+
+// Conductors are wired into nets, the groups of touching conductors that can all power
+// each other, with relays joining the pixels either side of them. Diodes only pass power
+// one way, so they join nets with one way links instead. Each update works out which
+// nets are reached from a live power source and writes the power levels back to the
+// pixels that changed, so a circuit costs the same each update however long its wires
+// are, and power crosses a net in a single update.
+//
+// Nets are rebuilt when a circuit pixel changes. Only those near the changed chunks
+// are thrown away and flooded again, so editing one corner of a build leaves the rest.
+class circuit
+{
+    struct net
+    {
+        std::vector<pixel_pos> pixels;
+        std::vector<pixel_pos> sources; // Power sources touching the net
+        std::vector<pixel_pos> outputs; // Pixels of other nets this one powers through a diode
+        bool                   alive = false;
+        bool                   powered = false;
+        bool                   written = false; // Whether the pixels have been given the power level
+    };
+
+    std::vector<net> d_nets;
+    std::vector<i32> d_free_nets;
+    std::vector<i32> d_net_ids; // Per pixel row by row, -1 for pixels in no net
+
+    // Per chunk, laid out like the chunks of the pixel world. Set by workers while
+    // stepping, so only ever written atomically.
+    std::vector<u8> d_changed;
+
+    i32 d_width;
+    i32 d_height;
+
+    // Scratch space for update, kept so it doesn't allocate every update
+    std::vector<pixel_pos> d_seeds;
+    std::vector<pixel_pos> d_stack;
+    std::vector<i32>       d_queue;
+    std::vector<bool>      d_reached;
+
+    auto net_id(pixel_pos pos) -> i32& { return d_net_ids[pos.y * d_width + pos.x]; }
+
+    auto release_net(i32 id) -> void;
+    auto flood_net(const pixel_world& w, pixel_pos seed) -> void;
+    auto rebuild(const pixel_world& w) -> void;
+    auto evaluate(pixel_world& w) -> void;
+
+public:
+    circuit(i32 width, i32 height);
+
+    // Called whenever the type of a pixel in the given chunk changes to or from a circuit
+    // type. Safe to call from workers stepping chunks in parallel.
+    auto mark_changed(std::size_t chunk) -> void;
+
+    // Rebuilds the changed nets and powers the nets reached from a live source. Must not
+    // run while chunks are being stepped.
+    auto update(pixel_world& w) -> void;
+};
+
+}
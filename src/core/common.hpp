@@ -1,4 +1,6 @@
 #pragma once
+#include <cstdint>
+#include <functional>
 #include <limits>
 
 #include <glm/glm.hpp>
@@ -28,6 +30,10 @@ static constexpr auto gravity = glm::vec2{0.0f, 9.81f};
 // Pixel Space
 static constexpr i32 chunk_size = 64;
 
+// The furthest a pixel can move in one update. Chunks stepped at the same time are a
+// whole chunk apart, so this leaves a few pixels either side for neighbour checks.
+static constexpr i32 max_pixel_travel = chunk_size / 2 - 4;
+
 // World Space
 static constexpr i32 pixels_per_meter = 16;
 
@@ -69,7 +75,10 @@ struct std::hash<sand::chunk_pos>
 {
     auto operator()(sand::chunk_pos pos) const noexcept -> std::size_t
     {
-        static const auto hasher = std::hash<sand::i32>{};
-        return hasher(pos.x) ^ hasher(pos.y);
+        // XORing the coordinates sends every chunk on a diagonal, {n, n}, to the same
+        // hash, so pack them into one word instead
+        const auto packed = (static_cast<sand::u64>(static_cast<sand::u32>(pos.x)) << 32)
+                          | static_cast<sand::u32>(pos.y);
+        return std::hash<sand::u64>{}(packed);
     }
 };
\ No newline at end of file
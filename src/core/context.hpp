@@ -10,9 +10,9 @@ class window;
 // needed in the update logic.
 struct context
 {
-    window* window;
-    input   input;
-    camera  camera;
+    sand::window* window;
+    sand::input   input;
+    sand::camera  camera;
 };
 
 }
\ No newline at end of file
@@ -0,0 +1,88 @@
+#include "debris.hpp"
+#include "world.hpp"
+
+#include <cmath>
+
+namespace sand {
+namespace {
+
+// Matches the acceleration of falling pixels in the grid
+constexpr auto debris_gravity = config::gravity * config::time_step;
+
+auto to_pixel(glm::vec2 pos) -> glm::ivec2
+{
+    return glm::ivec2{glm::floor(pos)};
+}
+
+enum class flight_result
+{
+    flying,
+    landed,
+    lost,
+};
+
+}
+
+auto debris::add(glm::vec2 pos, glm::vec2 velocity, const pixel& p) -> void
+{
+    d_positions.push_back(pos);
+    d_velocities.push_back(velocity);
+    d_pixels.push_back(p);
+}
+
+auto debris::step(pixel_world& w) -> void
+{
+    const auto flight = [&](std::size_t i) {
+        auto& pos = d_positions[i];
+        auto& velocity = d_velocities[i];
+        velocity += debris_gravity;
+
+        // Check every pixel passed through, as with move_offset, but only reading
+        const auto start = pos;
+        const auto steps = static_cast<i32>(std::ceil(glm::max(glm::abs(velocity.x), glm::abs(velocity.y))));
+        for (i32 s = 1; s <= steps; ++s) {
+            const auto next = start + velocity * (static_cast<float>(s) / steps);
+            const auto cell = to_pixel(next);
+            if (cell.x < 0 || cell.x >= w.width_in_pixels() || cell.y >= w.height_in_pixels()) {
+                return flight_result::lost;
+            }
+            if (cell.y >= 0 && w.type(pixel_pos::from_ivec2(cell)) != pixel_type::none) {
+                const auto last = to_pixel(pos);
+                if (last.y < 0 || w.type(pixel_pos::from_ivec2(last)) != pixel_type::none) {
+                    return flight_result::lost; // Nowhere free to land
+                }
+                // Only pixels that move carry on falling, anything else would be left
+                // flagged as falling forever and never count as static
+                auto p = d_pixels[i];
+                if (has_behaviour(behaviour(p.type), pixel_behaviour::moves)) {
+                    p.flags.set(is_falling);
+                    p.velocity = pack_velocity(velocity);
+                } else {
+                    p.flags.set(is_falling, false);
+                    p.velocity = {0, 0};
+                }
+                w.set(pixel_pos::from_ivec2(last), p);
+                return flight_result::landed;
+            }
+            pos = next;
+        }
+        return flight_result::flying;
+    };
+
+    // Particles that are done are swapped with the last one, which keeps the arrays
+    // packed and the order deterministic
+    for (std::size_t i = 0; i < d_positions.size();) {
+        if (flight(i) == flight_result::flying) {
+            ++i;
+            continue;
+        }
+        d_positions[i] = d_positions.back();
+        d_velocities[i] = d_velocities.back();
+        d_pixels[i] = d_pixels.back();
+        d_positions.pop_back();
+        d_velocities.pop_back();
+        d_pixels.pop_back();
+    }
+}
+
+}
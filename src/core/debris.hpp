@@ -0,0 +1,43 @@
+#pragma once
+#include "common.hpp"
+#include "pixel.hpp"
+
+#include <span>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace sand {
+
+class pixel_world;
+
+// The chance that a solid pixel destroyed by an explosion is thrown out as debris
+// rather than vanishing, and how fast it leaves in pixels per update
+static constexpr float debris_chance = 0.2f;
+static constexpr float debris_min_speed = 2.0f;
+static constexpr float debris_max_speed = 6.0f;
+
+// Pixels flying through the air. While in flight they are not part of the pixel world,
+// so moving them is a loop over flat arrays rather than a swap through every pixel on
+// the way, and nothing is woken until they land and are written back. Saving a level
+// only writes the pixel world, so particles still in flight are lost.
+class debris
+{
+    std::vector<glm::vec2> d_positions;
+    std::vector<glm::vec2> d_velocities; // Pixels per update
+    std::vector<pixel>     d_pixels;
+
+public:
+    auto add(glm::vec2 pos, glm::vec2 velocity, const pixel& p) -> void;
+
+    // Moves every particle along its path, writing those that hit something into the
+    // last free pixel before it. Particles leaving the sides or bottom of the world are
+    // lost, while those going over the top keep flying.
+    auto step(pixel_world& w) -> void;
+
+    inline auto size() const -> std::size_t { return d_positions.size(); }
+    inline auto positions() const -> std::span<const glm::vec2> { return d_positions; }
+    inline auto pixels() const -> std::span<const pixel> { return d_pixels; }
+};
+
+}
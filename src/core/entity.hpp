@@ -7,6 +7,7 @@
 #include "apecs.hpp"
 #include "utility.hpp"
 #include "input.hpp"
+#include "pixel.hpp"
 
 struct shape_id_hash
 {
@@ -63,12 +64,31 @@ struct life_component
 struct grenade_component
 {};
 
+// Solid pixels cut loose from the world, carried by the entity's body until it comes to
+// rest, see pixel_cluster.hpp
+struct pixel_cluster_component
+{
+    // The cluster's bounding box, row by row, with air where it has no pixel
+    std::vector<pixel> pixels;
+    i32                width  = 0;
+    i32                height = 0;
+
+    // The body's origin relative to the top left of the bounding box, in pixels
+    glm::vec2          origin = {0.0f, 0.0f};
+
+    i32                resting_updates = 0;
+
+    // Set once the colliders of the pixels it was cut from have been queued for rebuilding
+    bool               colliders_queued = false;
+};
+
 using registry = apx::registry<
     body_component,
     player_component,
     enemy_component,
     life_component,
-    grenade_component
+    grenade_component,
+    pixel_cluster_component
 >;
 
 auto add_player(registry& entities, b2WorldId world, pixel_pos position) -> entity;
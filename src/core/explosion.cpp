@@ -1,64 +1,287 @@
 #include "explosion.hpp"
+#include "world.hpp"
 #include "utility.hpp"
 
 #include <glm/glm.hpp>
-#include <glm/gtx/norm.hpp>
 
-#include <unordered_set>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numbers>
+#include <tuple>
+#include <vector>
 
 namespace sand {
 namespace {
 
-auto nearest_pixel(glm::vec2 pos) -> pixel_pos
+// The explosion is made of the rays from the centre to every pixel on the border of the
+// square of the given reach, 2 * reach + 1 per side, and each pixel belongs to the ray
+// that passes closest to it. That ray is found by projecting the pixel out onto the
+// border, which is much cheaper than comparing angles.
+struct explosion_ray
 {
-    return {static_cast<int>(pos.x), static_cast<int>(pos.y)};
+    float blast_limit;  // Pixels closer than this are destroyed
+    float scorch_limit; // And those beyond it but closer than this are scorched
+};
+
+auto ray_index(glm::ivec2 offset, i32 reach) -> std::size_t
+{
+    const auto side = 2 * reach + 1;
+    const auto ax = std::abs(offset.x);
+    const auto ay = std::abs(offset.y);
+    if (ax == 0 && ay == 0) return 0;
+
+    if (ay >= ax) {
+        const auto b = static_cast<i32>(std::lround(static_cast<float>(offset.x) * reach / ay));
+        return (offset.y > 0 ? 0 : side) + (b + reach);
+    }
+    const auto b = static_cast<i32>(std::lround(static_cast<float>(offset.y) * reach / ax));
+    return (offset.x > 0 ? 2 * side : 3 * side) + (b + reach);
+}
+
+// The border pixel the ray with the given index points at, the inverse of ray_index
+auto ray_target(std::size_t index, i32 reach) -> glm::ivec2
+{
+    const auto side = static_cast<std::size_t>(2 * reach + 1);
+    const auto b = static_cast<i32>(index % side) - reach;
+    switch (index / side) {
+        case 0: return {b, reach};
+        case 1: return {b, -reach};
+        case 2: return {reach, b};
+        default: return {-reach, b};
+    }
+}
+
+// What the explosions of a group do to each pixel in the group's box
+struct pixel_effect
+{
+    i32  destroyed_by = -1; // The explosion that destroyed the pixel, if any
+    bool ignited = false;
+    u8   scorch = 0;
+};
+
+struct explosion_box
+{
+    glm::ivec2 min;
+    glm::ivec2 max;
+};
+
+auto get_reach(const explosion& info) -> i32
+{
+    return static_cast<i32>(std::ceil(info.max_radius + 3 * info.scorch));
+}
+
+auto get_box(const pixel_world& w, const queued_explosion& e) -> explosion_box
+{
+    const auto reach = get_reach(e.info);
+    return {
+        glm::max(glm::ivec2{e.pos} - reach, glm::ivec2{0, 0}),
+        glm::min(glm::ivec2{e.pos} + reach, glm::ivec2{w.width_in_pixels() - 1, w.height_in_pixels() - 1})
+    };
+}
+
+auto overlaps(const explosion_box& a, const explosion_box& b) -> bool
+{
+    return a.min.x <= b.max.x && b.min.x <= a.max.x && a.min.y <= b.max.y && b.min.y <= a.max.y;
+}
+
+// Explosions with the same parameters and centres in the same cell of a grid, a quarter
+// of their smallest radius across, come out as one at the average of their centres. A
+// powered wall of c4 goes off a pixel at a time, so this is most of the saving.
+auto merge_close_explosions(std::span<const queued_explosion> explosions) -> std::vector<queued_explosion>
+{
+    const auto key = [](const queued_explosion& e) {
+        const auto cell = std::max(static_cast<i32>(e.info.min_radius / 4), 1);
+        return std::tuple{e.info.min_radius, e.info.max_radius, e.info.scorch, e.pos.y / cell, e.pos.x / cell};
+    };
+
+    auto sorted = std::vector<queued_explosion>(explosions.begin(), explosions.end());
+    std::ranges::stable_sort(sorted, {}, key);
+
+    auto merged = std::vector<queued_explosion>{};
+    for (auto first = sorted.begin(); first != sorted.end();) {
+        const auto last = std::find_if(first, sorted.end(), [&](const queued_explosion& e) {
+            return key(e) != key(*first);
+        });
+        auto total = glm::ivec2{0, 0};
+        for (auto it = first; it != last; ++it) {
+            total += glm::ivec2{it->pos};
+        }
+        const auto centre = total / static_cast<i32>(last - first);
+        merged.push_back({pixel_pos::from_ivec2(centre), first->info});
+        first = last;
+    }
+    return merged;
 }
 
-auto explosion_ray(pixel_world& w, glm::vec2 start, glm::vec2 end, const explosion& info) -> void
+// Rather than walking each ray, which rewrites the pixels near the centre once for every
+// ray passing over them, this only walks the rays to find how far each gets before
+// hitting titanium, then makes one pass over the square around the centre to record
+// what happens to every pixel in the group's buffer.
+auto add_explosion(
+    const pixel_world& w,
+    std::span<const queued_explosion> explosions,
+    i32 index,
+    const explosion_box& group,
+    std::vector<pixel_effect>& effects
+) -> void
 {
-    // Calculate a step length small enough to hit every pixel on the path.
-    const auto line = end - start;
-    const auto step = line / glm::max(glm::abs(line.x), glm::abs(line.y));
+    const auto& e = explosions[index];
+    const auto& info = e.info;
+    const auto reach = get_reach(info);
+    const auto centre = glm::ivec2{e.pos};
+    const auto [min, max] = get_box(w, e);
+    const auto group_width = group.max.x - group.min.x + 1;
+
+    auto rays = std::vector<explosion_ray>(4 * (2 * reach + 1));
+    for (auto& ray : rays) {
+        ray.blast_limit = random_from_range(info.min_radius, info.max_radius);
+    }
 
-    auto curr = start;
+    // A ray is stopped by the first titanium pixel on its line, which shields everything
+    // behind it. Each step moves one pixel along the ray's longer axis.
+    for (std::size_t i = 0; i != rays.size(); ++i) {
+        auto& ray = rays[i];
+        const auto target = glm::vec2{ray_target(i, reach)};
+        for (i32 step = 1; step <= reach; ++step) {
+            const auto offset = glm::ivec2{glm::round(target * static_cast<float>(step) / static_cast<float>(reach))};
+            const auto distance = glm::length(glm::vec2{offset});
+            if (distance >= ray.blast_limit) break;
 
-    const auto blast_limit = random_from_range(info.min_radius, info.max_radius);
-    while (w.is_valid_pixel(nearest_pixel(curr)) && glm::length2(curr - start) < glm::pow(blast_limit, 2)) {
-        if (w[nearest_pixel(curr)].type == pixel_type::titanium) {
-            break;
+            const auto pos = centre + offset;
+            if (!w.is_valid_pixel(pixel_pos::from_ivec2(pos))) break;
+            if (w.type(pixel_pos::from_ivec2(pos)) == pixel_type::titanium) {
+                ray.blast_limit = distance;
+                break;
+            }
         }
-        w.set(nearest_pixel(curr), random_unit() < 0.05f ? pixel::ember() : pixel::air());
-        curr += step;
     }
-    
-    // Try to catch light to the first scorched pixel
-    if (w.is_valid_pixel(nearest_pixel(curr))) {
-        if (random_unit() < properties(w[nearest_pixel(curr)]).flammability) {
-            w.visit(nearest_pixel(curr), [&](pixel& p) { p.flags[is_burning] = true; });
+
+    // The scorch distance is cut off at three standard deviations to bound the square
+    auto furthest = 0.0f;
+    for (auto& ray : rays) {
+        const auto scorch = std::min(std::abs(random_normal(0.0f, info.scorch)), 3 * info.scorch);
+        ray.scorch_limit = ray.blast_limit + scorch;
+        furthest = std::max(furthest, ray.scorch_limit);
+    }
+
+    for (i32 y = min.y; y <= max.y; ++y) {
+        for (i32 x = min.x; x <= max.x; ++x) {
+            const auto offset = glm::ivec2{x, y} - centre;
+            const auto distance = glm::length(glm::vec2{offset});
+            if (distance >= furthest) continue;
+            const auto& ray = rays[ray_index(offset, reach)];
+            auto& effect = effects[(y - group.min.y) * group_width + (x - group.min.x)];
+
+            if (distance < ray.blast_limit) {
+                if (w.type({x, y}) != pixel_type::titanium) {
+                    effect.destroyed_by = index;
+                }
+            }
+            else if (distance < ray.scorch_limit && w.type({x, y}) != pixel_type::none) {
+                const auto& props = properties(w.type({x, y}));
+
+                // Try to catch light to the first scorched pixel
+                if (distance < ray.blast_limit + 1.0f && random_unit() < props.flammability) {
+                    effect.ignited = true;
+                }
+                if (props.phase == pixel_phase::solid && effect.scorch != std::numeric_limits<u8>::max()) {
+                    ++effect.scorch;
+                }
+            }
         }
     }
+}
 
-    const auto scorch_limit = glm::length(curr - start) + std::abs(random_normal(0.0f, info.scorch));
-    while (w.is_valid_pixel(nearest_pixel(curr)) && glm::length2(curr - start) < glm::pow(scorch_limit, 2)) {
-        if (properties(w[nearest_pixel(curr)]).phase == pixel_phase::solid) {
-            w.visit(nearest_pixel(curr), [&](pixel& p) { p.colour *= 0.8f; });
+auto write_effects(
+    pixel_world& w,
+    std::span<const queued_explosion> explosions,
+    const explosion_box& group,
+    const std::vector<pixel_effect>& effects
+) -> void
+{
+    const auto group_width = group.max.x - group.min.x + 1;
+    for (i32 y = group.min.y; y <= group.max.y; ++y) {
+        for (i32 x = group.min.x; x <= group.max.x; ++x) {
+            const auto& effect = effects[(y - group.min.y) * group_width + (x - group.min.x)];
+            if (effect.destroyed_by != -1) {
+                // Some solid pixels are thrown away from the explosion that destroyed them
+                const auto p = w[pixel_pos{x, y}];
+                if (p.type != pixel_type::none && properties(p.type).phase == pixel_phase::solid && random_unit() < debris_chance) {
+                    const auto offset = glm::vec2{x, y} - glm::vec2{glm::ivec2{explosions[effect.destroyed_by].pos}};
+                    const auto direction = offset == glm::vec2{0.0f, 0.0f} ? glm::vec2{0.0f, -1.0f} : glm::normalize(offset);
+                    const auto speed = random_from_range(debris_min_speed, debris_max_speed);
+                    w.flying_debris().add(glm::vec2{x + 0.5f, y + 0.5f}, speed * direction, p);
+                }
+                w.visit_no_wake({x, y}, [&](pixel& p) {
+                    p = random_unit() < 0.05f ? pixel::ember() : pixel::air();
+                });
+            }
+            else if (effect.ignited || effect.scorch > 0) {
+                w.visit_no_wake({x, y}, [&](pixel& p) {
+                    if (effect.ignited) p.flags.set(is_burning);
+                    p.scorch = static_cast<u8>(std::min<i32>(p.scorch + effect.scorch, std::numeric_limits<u8>::max()));
+                });
+            }
         }
-        curr += step;
     }
+    w.wake_pixels(group.min, group.max);
 }
 
 }
 
 auto apply_explosion(pixel_world& w, pixel_pos pos, const explosion& info) -> void
 {
-    const auto p = glm::vec2{pos.x, pos.y};
-    const auto a = info.max_radius + 3 * info.scorch;
-    for (int b = -a; b != a + 1; ++b) {
-        explosion_ray(w, p, p + glm::vec2{b, a}, info);
-        explosion_ray(w, p, p + glm::vec2{b, -a}, info);
-        explosion_ray(w, p, p + glm::vec2{a, b}, info);
-        explosion_ray(w, p, p + glm::vec2{-a, b}, info);
+    const auto e = queued_explosion{pos, info};
+    apply_explosions(w, std::span{&e, 1});
+}
+
+auto apply_explosions(pixel_world& w, std::span<const queued_explosion> explosions) -> void
+{
+    const auto merged = merge_close_explosions(explosions);
+
+    // Explosions whose boxes overlap, even through others, are worked out together
+    auto boxes = std::vector<explosion_box>{};
+    auto groups = std::vector<std::size_t>(merged.size());
+    for (std::size_t i = 0; i != merged.size(); ++i) {
+        boxes.push_back(get_box(w, merged[i]));
+        groups[i] = i;
+    }
+    const auto find = [&](std::size_t i) {
+        while (groups[i] != i) i = groups[i] = groups[groups[i]];
+        return i;
+    };
+    for (std::size_t i = 0; i != merged.size(); ++i) {
+        for (std::size_t j = 0; j != i; ++j) {
+            if (overlaps(boxes[i], boxes[j])) {
+                groups[find(i)] = find(j);
+            }
+        }
+    }
+
+    auto effects = std::vector<pixel_effect>{};
+    for (std::size_t root = 0; root != merged.size(); ++root) {
+        if (find(root) != root) continue;
+
+        auto group = boxes[root];
+        for (std::size_t i = 0; i != merged.size(); ++i) {
+            if (find(i) != root) continue;
+            group.min = glm::min(group.min, boxes[i].min);
+            group.max = glm::max(group.max, boxes[i].max);
+        }
+
+        effects.assign((group.max.x - group.min.x + 1) * (group.max.y - group.min.y + 1), pixel_effect{});
+        for (std::size_t i = 0; i != merged.size(); ++i) {
+            if (find(i) == root) {
+                add_explosion(w, merged, static_cast<i32>(i), group, effects);
+            }
+        }
+        write_effects(w, merged, group, effects);
+    }
+
+    for (const auto& [pos, info] : merged) {
+        w.record_blast({pos, static_cast<i32>(std::ceil(info.max_radius))});
     }
 }
 
-}
\ No newline at end of file
+}
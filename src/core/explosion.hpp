@@ -1,11 +1,14 @@
 #pragma once
-#include "world.hpp"
 #include "common.hpp"
 
+#include <span>
+
 #include <glm/glm.hpp>
 
 namespace sand {
 
+class pixel_world;
+
 struct explosion
 {
     // Radii from the centre to try and destroy
@@ -17,6 +20,27 @@ struct explosion
     float scorch;
 };
 
+// Where an explosion went off and how far it could reach
+struct blast
+{
+    pixel_pos pos;
+    i32       radius;
+};
+
+struct queued_explosion
+{
+    pixel_pos pos;
+    explosion info;
+};
+
 auto apply_explosion(pixel_world& w, pixel_pos pos, const explosion& info) -> void;
 
+// Applies a batch of explosions together. Identical explosions going off within a few
+// pixels of each other are merged into one, and those whose areas overlap are worked out
+// into a shared buffer before being written to the world, so each pixel is only written
+// once however many explosions reach it. Merging sorts them by radii, scorch and the
+// cell of the grid their centre is in, and they go off, random draws included, group by
+// group in that order. The order they are given in makes no difference.
+auto apply_explosions(pixel_world& w, std::span<const queued_explosion> explosions) -> void;
+
 }
\ No newline at end of file
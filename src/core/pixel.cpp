@@ -1,257 +1,85 @@
 #include "pixel.hpp"
 #include "utility.hpp"
 
+#include <array>
+#include <cmath>
 #include <cstdlib>
-#include <print>
+#include <random>
 #include <vector>
 
 namespace sand {
 namespace {
 
-auto light_noise() -> glm::vec4
+// The base colour of each pixel type, in the same order as pixel_type. Types with
+// noise get colour variants that are randomly perturbed from the base colour.
+struct base_colour
 {
-    return {
-        random_from_range(-0.04f, 0.04f),
-        random_from_range(-0.04f, 0.04f),
-        random_from_range(-0.04f, 0.04f),
-        1.0f
-    };
-}
+    int  hex;
+    bool noise;
+};
 
-}
+constexpr auto base_colours = std::array{
+    base_colour{0x000000, false}, // none
+    base_colour{0xF8EFBA, true},  // sand
+    base_colour{0x5C1D06, true},  // dirt
+    base_colour{0x1E272E, true},  // coal
+    base_colour{0x1B9CFC, true},  // water
+    base_colour{0xF97F51, true},  // lava
+    base_colour{0x2ED573, true},  // acid
+    base_colour{0xC8C8C8, true},  // rock
+    base_colour{0xDFE4EA, false}, // titanium
+    base_colour{0x9AECDB, true},  // steam
+    base_colour{0x45AAF2, true},  // fuse
+    base_colour{0xFFFFFF, false}, // ember
+    base_colour{0x650C30, true},  // oil
+    base_colour{0x485460, true},  // gunpowder
+    base_colour{0xCED6E0, true},  // methane
+    base_colour{0xF0932B, false}, // battery
+    base_colour{0xB2BEC3, false}, // solder
+    base_colour{0x22A6B3, false}, // diode_in
+    base_colour{0xBE2EDD, false}, // diode_out
+    base_colour{0xE1B12C, false}, // spark
+    base_colour{0xB8E994, false}, // c4
+    base_colour{0x192A56, false}  // relay
+};
+
+static_assert(base_colours.size() == static_cast<std::size_t>(pixel_type::relay) + 1);
+
+using colour_palette = std::array<std::array<glm::vec4, num_colour_variants>, base_colours.size()>;
 
-auto properties(const pixel& pix) -> const pixel_properties&
+auto make_palette() -> colour_palette
 {
-    switch (pix.type) {
-        case pixel_type::none: {
-            static constexpr auto px = pixel_properties{
-                .phase = pixel_phase::gas,
-                .corrosion_resist = 1.0f
-            };
-            return px;
-        }
-        case pixel_type::sand: {
-            static constexpr auto px = pixel_properties{
-                .can_move_diagonally = true,
-                .gravity_factor = 1.0f,
-                .inertial_resistance = 0.1f,
-                .corrosion_resist = 0.3f
-            };
-            return px;
-        }
-        case pixel_type::dirt: {
-            static constexpr auto px = pixel_properties{
-                .can_move_diagonally = true,
-                .gravity_factor = 1.0f,
-                .inertial_resistance = 0.4f,
-                .corrosion_resist = 0.5f
-            };
-            return px;
-        }
-        case pixel_type::coal: {
-            static constexpr auto px = pixel_properties{
-                .can_move_diagonally = true,
-                .gravity_factor = 1.0f,
-                .inertial_resistance = 0.95f,
-                .corrosion_resist = 0.8f,
-                .flammability = 0.02f,
-                .put_out_surrounded = 0.15f,
-                .put_out = 0.02f,
-                .burn_out_chance = 0.005f
-            };
-            return px;
-        }
-        case pixel_type::water: {
-            static constexpr auto px = pixel_properties{
-                .phase = pixel_phase::liquid,
-                .can_move_diagonally = true,
-                .gravity_factor = 1.0f,
-                .dispersion_rate = 5,
-                .corrosion_resist = 1.0f,
-            };
-            return px;
-        }
-        case pixel_type::lava: {
-            static constexpr auto px = pixel_properties{
-                .phase = pixel_phase::liquid,
-                .can_move_diagonally = true,
-                .gravity_factor = 1.0f,
-                .dispersion_rate = 1,
-                .can_boil_water = true,
-                .corrosion_resist = 1.0f,
-                .is_burn_source = true,
-                .is_ember_source = true
-            };
-            return px;
-        }
-        case pixel_type::acid: {
-            static constexpr auto px = pixel_properties{
-                .phase = pixel_phase::liquid,
-                .can_move_diagonally = true,
-                .gravity_factor = 1.0f,
-                .dispersion_rate = 1,
-                .corrosion_resist = 1.0f,
-                .is_corrosion_source = true
-            };
-            return px;
-        }
-        case pixel_type::rock: {
-            static constexpr auto px = pixel_properties{
-                .corrosion_resist = 0.95f,
-            };
-            return px;
-        }
-        case pixel_type::titanium: {
-            static constexpr auto px = pixel_properties{
-                .corrosion_resist = 1.0f,
-                .power_type = pixel_power_type::conductor,
-                .power_max = 25
-            };
-            return px;
-        }
-        case pixel_type::steam: {
-            static constexpr auto px = pixel_properties{
-                .phase = pixel_phase::gas,
-                .can_move_diagonally = true,
-                .gravity_factor = -1.0f,
-                .dispersion_rate = 9,
-                .corrosion_resist = 0.0f
-            };
-            return px;
-        }
-        case pixel_type::fuse: {
-            static constexpr auto px = pixel_properties{
-                .corrosion_resist = 0.1f,
-                .flammability = 0.25f,
-                .put_out_surrounded = 0.0f,
-                .put_out = 0.0f,
-                .burn_out_chance = 0.1f
-            };
-            return px;
-        }
-        case pixel_type::ember: {
-            static constexpr auto px = pixel_properties{
-                .phase = pixel_phase::gas,
-                .can_move_diagonally = true,
-                .gravity_factor = -1.0f,
-                .always_awake = true,
-                .corrosion_resist = 0.1f,
-                .flammability = 1.0f,
-                .put_out_surrounded = 0.0f,
-                .put_out = 0.0f,
-                .burn_out_chance = 0.2f
-            };
-            return px;
-        }
-        case pixel_type::oil: {
-            static constexpr auto px = pixel_properties{
-                .phase = pixel_phase::liquid,
-                .can_move_diagonally = true,
-                .gravity_factor = 1.0f,
-                .dispersion_rate = 2,
-                .corrosion_resist = 0.1f,
-                .flammability = 0.05f,
-                .put_out_surrounded = 0.3f,
-                .put_out = 0.02f,
-                .burn_out_chance = 0.005f
-            };
-            return px;
-        }
-        case pixel_type::gunpowder: {
-            static constexpr auto px = pixel_properties{
-                .can_move_diagonally = true,
-                .gravity_factor = 1.0f,
-                .inertial_resistance = 0.1f,
-                .corrosion_resist = 0.1f,
-                .flammability = 0.25f,
-                .put_out_surrounded = 0.0f,
-                .put_out = 0.0f,
-                .burn_out_chance = 0.1f,
-                .explosion_chance = 0.001f
-            };
-            return px;
-        }
-        case pixel_type::methane: {
-            static constexpr auto px = pixel_properties{
-                .phase = pixel_phase::gas,
-                .can_move_diagonally = true,
-                .gravity_factor = -1.0f,
-                .dispersion_rate = 4,
-                .corrosion_resist = 0.0f,
-                .flammability = 0.25f,
-                .put_out_surrounded = 0.0f,
-                .put_out = 0.0f,
-                .burn_out_chance = 0.1f
-            };
-            return px;
-        }
-        case pixel_type::battery: {
-            static constexpr auto px = pixel_properties{
-                .always_awake = true,
-                .corrosion_resist = 1.0f,
-                .power_type = pixel_power_type::source,
-                .power_max = 5
-            };
-            return px;
-        }
-        case pixel_type::solder: {
-            static constexpr auto px = pixel_properties{
-                .can_move_diagonally = true,
-                .gravity_factor = 1.0f,
-                .inertial_resistance = 0.05f,
-                .corrosion_resist = 1.0f,
-                .power_type = pixel_power_type::conductor,
-                .power_max = 24
-            };
-            return px;
-        }
-        case pixel_type::diode_in:
-        case pixel_type::diode_out: {
-            static constexpr auto px = pixel_properties{
-                .corrosion_resist = 1.0f,
-                .power_type = pixel_power_type::conductor,
-                .power_max = 25
-            };
-            return px;
-        }
-        case pixel_type::spark: {
-            static constexpr auto px = pixel_properties{
-                .always_awake = true,
-                .spontaneous_destroy = 0.3f,
-                .corrosion_resist = 0.1f,
-                .power_type = pixel_power_type::source,
-                .power_max = 100
-            };
-            return px;
-        }
-        case pixel_type::c4: {
-            static constexpr auto px = pixel_properties{
-                .corrosion_resist = 0.95f,
-                .explodes_on_power = true,
-                .power_type = pixel_power_type::conductor,
-                .power_max = 10
-            };
-            return px;
-        }
-        case pixel_type::relay: {
-            static constexpr auto px = pixel_properties{
-                .corrosion_resist = 1.0f
-            };
-            return px;
-        }
-        default: {
-            std::print("ERROR: Unknown pixel type {}\n", static_cast<int>(pix.type));
-            static constexpr auto px = pixel_properties{};
-            return px;
+    // Uses its own fixed generator so that saved pixels look the same every run
+    auto gen = std::minstd_rand{};
+    auto noise = std::uniform_real_distribution(-0.04f, 0.04f);
+
+    auto palette = colour_palette{};
+    for (std::size_t type = 0; type != base_colours.size(); ++type) {
+        const auto [hex, has_noise] = base_colours[type];
+        for (auto& colour : palette[type]) {
+            colour = from_hex(hex);
+            if (has_noise) {
+                colour += glm::vec4{noise(gen), noise(gen), noise(gen), 0.0f};
+            }
         }
     }
+
+    // Air is see-through
+    palette[static_cast<std::size_t>(pixel_type::none)].fill(glm::vec4{0.0f, 0.0f, 0.0f, 0.0f});
+    return palette;
+}
+
+auto random_colour_variant() -> std::uint8_t
+{
+    return static_cast<std::uint8_t>(random_from_range(0, num_colour_variants - 1));
+}
+
 }
 
 auto pixel::air() -> pixel
 {
     return pixel{
-        .type = pixel_type::none,
-        .colour = {0.0f, 0.0f, 0.0f, 0.0f}
+        .type = pixel_type::none
     };
 }
 
@@ -259,9 +87,9 @@ auto pixel::sand() -> pixel
 {
     auto p = pixel{
         .type = pixel_type::sand,
-        .colour = from_hex(0xF8EFBA) + light_noise()
+        .colour = random_colour_variant()
     };
-    p.flags[is_falling] = true;
+    p.flags.set(is_falling);
     return p;
 }
 
@@ -269,9 +97,9 @@ auto pixel::coal() -> pixel
 {
     auto p = pixel{
         .type = pixel_type::coal,
-        .colour = from_hex(0x1E272E) + light_noise()
+        .colour = random_colour_variant()
     };
-    p.flags[is_falling] = true;
+    p.flags.set(is_falling);
     return p;
 }
 
@@ -279,9 +107,9 @@ auto pixel::dirt() -> pixel
 {
     auto p = pixel{
         .type = pixel_type::dirt,
-        .colour = from_hex(0x5C1D06) + light_noise()
+        .colour = random_colour_variant()
     };
-    p.flags[is_falling] = true;
+    p.flags.set(is_falling);
     return p;
 }
 
@@ -289,7 +117,7 @@ auto pixel::rock() -> pixel
 {
     return {
         .type = pixel_type::rock,
-        .colour = from_hex(0xC8C8C8) + light_noise()
+        .colour = random_colour_variant()
     };
 }
 
@@ -297,7 +125,7 @@ auto pixel::water() -> pixel
 {
     return {
         .type = pixel_type::water,
-        .colour = from_hex(0x1B9CFC) + light_noise()
+        .colour = random_colour_variant()
     };
 }
 
@@ -305,7 +133,7 @@ auto pixel::lava() -> pixel
 {
     return {
         .type = pixel_type::lava,
-        .colour = from_hex(0xF97F51) + light_noise()
+        .colour = random_colour_variant()
     };
 }
 
@@ -313,7 +141,7 @@ auto pixel::acid() -> pixel
 {
     return {
         .type = pixel_type::acid,
-        .colour = from_hex(0x2ED573) + light_noise()
+        .colour = random_colour_variant()
     };
 }
 
@@ -321,15 +149,14 @@ auto pixel::steam() -> pixel
 {
     return {
         .type = pixel_type::steam,
-        .colour = from_hex(0x9AECDB) + light_noise()
+        .colour = random_colour_variant()
     };
 }
 
 auto pixel::titanium() -> pixel
 {
     return {
-        .type = pixel_type::titanium,
-        .colour = from_hex(0xDFE4EA)
+        .type = pixel_type::titanium
     };
 }
 
@@ -337,17 +164,16 @@ auto pixel::fuse() -> pixel
 {
     return {
         .type = pixel_type::fuse,
-        .colour = from_hex(0x45AAF2) + light_noise()
+        .colour = random_colour_variant()
     };
 }
 
 auto pixel::ember() -> pixel
 {
     auto p = pixel{
-        .type = pixel_type::ember,
-        .colour = from_hex(0xFFFFFF)
+        .type = pixel_type::ember
     };
-    p.flags[is_burning] = true;
+    p.flags.set(is_burning);
     return p;
 }
 
@@ -355,7 +181,7 @@ auto pixel::oil() -> pixel
 {
     return {
         .type = pixel_type::oil,
-        .colour = from_hex(0x650C30) + light_noise()
+        .colour = random_colour_variant()
     };
 }
 
@@ -363,9 +189,9 @@ auto pixel::gunpowder() -> pixel
 {
     auto p = pixel{
         .type = pixel_type::gunpowder,
-        .colour = from_hex(0x485460) + light_noise()
+        .colour = random_colour_variant()
     };
-    p.flags[is_falling] = true;
+    p.flags.set(is_falling);
     return p;
 }
 
@@ -373,49 +199,44 @@ auto pixel::methane() -> pixel
 {
     return {
         .type = pixel_type::methane,
-        .colour = from_hex(0xCED6E0) + light_noise()
+        .colour = random_colour_variant()
     };
 }
 
 auto pixel::battery() -> pixel
 {
     return {
-        .type = pixel_type::battery,
-        .colour = from_hex(0xF0932B)
+        .type = pixel_type::battery
     };
 }
 
 auto pixel::solder() -> pixel
 {
     auto p = pixel{
-        .type = pixel_type::solder,
-        .colour = from_hex(0xB2BEC3)
+        .type = pixel_type::solder
     };
-    p.flags[is_falling] = true;
+    p.flags.set(is_falling);
     return p;
 }
 
 auto pixel::diode_in() -> pixel
 {
     return {
-        .type = pixel_type::diode_in,
-        .colour = from_hex(0x22A6B3)
+        .type = pixel_type::diode_in
     };
 }
 
 auto pixel::diode_out() -> pixel
 {
     return {
-        .type = pixel_type::diode_out,
-        .colour = from_hex(0xBE2EDD)
+        .type = pixel_type::diode_out
     };
 }
 
 auto pixel::spark() -> pixel
 {
     auto p = pixel{
-        .type = pixel_type::spark,
-        .colour = from_hex(0xE1B12C)
+        .type = pixel_type::spark
     };
     p.power = properties(p).power_max;
     return p;
@@ -424,19 +245,44 @@ auto pixel::spark() -> pixel
 auto pixel::c4() -> pixel
 {
     return {
-        .type = pixel_type::c4,
-        .colour = from_hex(0xB8E994)
+        .type = pixel_type::c4
     };
 }
 
 auto pixel::relay() -> pixel
 {
     return {
-        .type = pixel_type::relay,
-        .colour = from_hex(0x192A56)
+        .type = pixel_type::relay
     };
 }
 
+auto pack_velocity(glm::vec2 velocity) -> glm::i8vec2
+{
+    const auto scaled = glm::round(velocity * velocity_scale);
+    return glm::i8vec2{glm::clamp(scaled, glm::vec2{-127.0f}, glm::vec2{127.0f})};
+}
+
+auto unpack_velocity(glm::i8vec2 velocity) -> glm::vec2
+{
+    return glm::vec2{velocity} / velocity_scale;
+}
+
+auto pixel_colour(const pixel& px) -> glm::vec4
+{
+    static const auto palette = make_palette();
+    const auto colour = palette[static_cast<std::size_t>(px.type)][px.colour % num_colour_variants];
+    if (px.scorch == 0) {
+        return colour;
+    }
+    const auto darken = std::pow(0.8f, static_cast<float>(px.scorch));
+    return colour * glm::vec4{darken, darken, darken, 1.0f};
+}
+
+auto has_colour_noise(pixel_type type) -> bool
+{
+    return base_colours[static_cast<std::size_t>(type)].noise;
+}
+
 auto is_active_power_source(const pixel& px) -> bool
 {
     const auto& props = properties(px);
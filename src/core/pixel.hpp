@@ -1,17 +1,37 @@
 #pragma once
 #include <glm/glm.hpp>
+#include <glm/gtc/type_precision.hpp>
 #include <box2d/box2d.h>
 
-#include <bitset>
+#include <array>
+#include <cassert>
 #include <cstdint>
+#include <utility>
 
 namespace sand {
 
-enum pixel_flags : std::size_t
+enum pixel_flags : std::uint8_t
 {
-    is_updated, // 0
-    is_falling, // 1
-    is_burning, // 2
+    is_falling,
+    is_burning,
+};
+
+// A set of pixel_flags packed into a single byte
+class pixel_flag_set
+{
+    std::uint8_t d_bits = 0;
+
+public:
+    auto test(pixel_flags flag) const -> bool { return d_bits & (1 << flag); }
+    auto operator[](pixel_flags flag) const -> bool { return test(flag); }
+
+    auto set(pixel_flags flag, bool value = true) -> void
+    {
+        if (value) d_bits |= (1 << flag);
+        else       d_bits &= ~(1 << flag);
+    }
+
+    auto serialise(auto& archive) -> void { archive(d_bits); }
 };
 
 enum class pixel_phase : std::uint8_t
@@ -64,7 +84,7 @@ struct pixel_properties
     int         dispersion_rate     = 0;
 
     // Simulator Specifics
-    bool        always_awake        = false; // If enabled, then the chunk never sleeps
+    bool        always_awake        = false; // If enabled, updated every step even when its chunk sleeps
 
     // Misc
     float       spontaneous_destroy = 0.0f; // Chance the pixel randomly dies
@@ -91,16 +111,239 @@ struct pixel_properties
     std::uint8_t     power_max      = 0; // The maximum power this pixel can accept
 };
 
+static constexpr auto num_pixel_types = std::to_underlying(pixel_type::relay) + 1;
+
+// Indexed by pixel_type, see properties
+static constexpr auto pixel_properties_table = [] {
+    auto table = std::array<pixel_properties, num_pixel_types>{};
+    table[std::to_underlying(pixel_type::none)] = {
+        .phase = pixel_phase::gas,
+        .corrosion_resist = 1.0f
+    };
+    table[std::to_underlying(pixel_type::sand)] = {
+        .can_move_diagonally = true,
+        .gravity_factor = 1.0f,
+        .inertial_resistance = 0.1f,
+        .corrosion_resist = 0.3f
+    };
+    table[std::to_underlying(pixel_type::dirt)] = {
+        .can_move_diagonally = true,
+        .gravity_factor = 1.0f,
+        .inertial_resistance = 0.4f,
+        .corrosion_resist = 0.5f
+    };
+    table[std::to_underlying(pixel_type::coal)] = {
+        .can_move_diagonally = true,
+        .gravity_factor = 1.0f,
+        .inertial_resistance = 0.95f,
+        .corrosion_resist = 0.8f,
+        .flammability = 0.02f,
+        .put_out_surrounded = 0.15f,
+        .put_out = 0.02f,
+        .burn_out_chance = 0.005f
+    };
+    table[std::to_underlying(pixel_type::water)] = {
+        .phase = pixel_phase::liquid,
+        .can_move_diagonally = true,
+        .gravity_factor = 1.0f,
+        .dispersion_rate = 5,
+        .corrosion_resist = 1.0f
+    };
+    table[std::to_underlying(pixel_type::lava)] = {
+        .phase = pixel_phase::liquid,
+        .can_move_diagonally = true,
+        .gravity_factor = 1.0f,
+        .dispersion_rate = 1,
+        .can_boil_water = true,
+        .corrosion_resist = 1.0f,
+        .is_burn_source = true,
+        .is_ember_source = true
+    };
+    table[std::to_underlying(pixel_type::acid)] = {
+        .phase = pixel_phase::liquid,
+        .can_move_diagonally = true,
+        .gravity_factor = 1.0f,
+        .dispersion_rate = 1,
+        .corrosion_resist = 1.0f,
+        .is_corrosion_source = true
+    };
+    table[std::to_underlying(pixel_type::rock)] = {
+        .corrosion_resist = 0.95f
+    };
+    table[std::to_underlying(pixel_type::titanium)] = {
+        .corrosion_resist = 1.0f,
+        .power_type = pixel_power_type::conductor,
+        .power_max = 25
+    };
+    table[std::to_underlying(pixel_type::steam)] = {
+        .phase = pixel_phase::gas,
+        .can_move_diagonally = true,
+        .gravity_factor = -1.0f,
+        .dispersion_rate = 9,
+        .corrosion_resist = 0.0f
+    };
+    table[std::to_underlying(pixel_type::fuse)] = {
+        .corrosion_resist = 0.1f,
+        .flammability = 0.25f,
+        .put_out_surrounded = 0.0f,
+        .put_out = 0.0f,
+        .burn_out_chance = 0.1f
+    };
+    table[std::to_underlying(pixel_type::ember)] = {
+        .phase = pixel_phase::gas,
+        .can_move_diagonally = true,
+        .gravity_factor = -1.0f,
+        .always_awake = true,
+        .corrosion_resist = 0.1f,
+        .flammability = 1.0f,
+        .put_out_surrounded = 0.0f,
+        .put_out = 0.0f,
+        .burn_out_chance = 0.2f
+    };
+    table[std::to_underlying(pixel_type::oil)] = {
+        .phase = pixel_phase::liquid,
+        .can_move_diagonally = true,
+        .gravity_factor = 1.0f,
+        .dispersion_rate = 2,
+        .corrosion_resist = 0.1f,
+        .flammability = 0.05f,
+        .put_out_surrounded = 0.3f,
+        .put_out = 0.02f,
+        .burn_out_chance = 0.005f
+    };
+    table[std::to_underlying(pixel_type::gunpowder)] = {
+        .can_move_diagonally = true,
+        .gravity_factor = 1.0f,
+        .inertial_resistance = 0.1f,
+        .corrosion_resist = 0.1f,
+        .flammability = 0.25f,
+        .put_out_surrounded = 0.0f,
+        .put_out = 0.0f,
+        .burn_out_chance = 0.1f,
+        .explosion_chance = 0.001f
+    };
+    table[std::to_underlying(pixel_type::methane)] = {
+        .phase = pixel_phase::gas,
+        .can_move_diagonally = true,
+        .gravity_factor = -1.0f,
+        .dispersion_rate = 4,
+        .corrosion_resist = 0.0f,
+        .flammability = 0.25f,
+        .put_out_surrounded = 0.0f,
+        .put_out = 0.0f,
+        .burn_out_chance = 0.1f
+    };
+    table[std::to_underlying(pixel_type::battery)] = {
+        .always_awake = true,
+        .corrosion_resist = 1.0f,
+        .power_type = pixel_power_type::source,
+        .power_max = 5
+    };
+    table[std::to_underlying(pixel_type::solder)] = {
+        .can_move_diagonally = true,
+        .gravity_factor = 1.0f,
+        .inertial_resistance = 0.05f,
+        .corrosion_resist = 1.0f,
+        .power_type = pixel_power_type::conductor,
+        .power_max = 24
+    };
+    table[std::to_underlying(pixel_type::diode_in)] = {
+        .corrosion_resist = 1.0f,
+        .power_type = pixel_power_type::conductor,
+        .power_max = 25
+    };
+    table[std::to_underlying(pixel_type::diode_out)] = {
+        .corrosion_resist = 1.0f,
+        .power_type = pixel_power_type::conductor,
+        .power_max = 25
+    };
+    table[std::to_underlying(pixel_type::spark)] = {
+        .always_awake = true,
+        .spontaneous_destroy = 0.3f,
+        .corrosion_resist = 0.1f,
+        .power_type = pixel_power_type::source,
+        .power_max = 100
+    };
+    table[std::to_underlying(pixel_type::c4)] = {
+        .corrosion_resist = 0.95f,
+        .explodes_on_power = true,
+        .power_type = pixel_power_type::conductor,
+        .power_max = 10
+    };
+    table[std::to_underlying(pixel_type::relay)] = {
+        .corrosion_resist = 1.0f
+    };
+    return table;
+}();
+
+// A coarse summary of what each pixel type can do, derived from its properties. This
+// lets the update skip whole stages for types that can never need them.
+enum class pixel_behaviour : std::uint8_t
+{
+    moves    = 1 << 0, // Falls, rises or spreads out
+    reacts   = 1 << 1, // Boils, corrodes, burns or throws embers at its neighbours
+    burns    = 1 << 2, // Can catch fire, and so react and burn out while burning
+    powers   = 1 << 3, // Is a power source, conductors are left to the circuit
+    decays   = 1 << 4, // Can spontaneously destroy itself
+    wakes    = 1 << 5, // Updates every step without waking its chunk, see keep_active
+};
+
+static constexpr auto pixel_behaviour_table = [] {
+    auto table = std::array<std::uint8_t, num_pixel_types>{};
+    for (std::size_t i = 0; i != num_pixel_types; ++i) {
+        const auto& p = pixel_properties_table[i];
+        auto mask = std::uint8_t{0};
+        const auto add = [&](pixel_behaviour b) { mask |= std::to_underlying(b); };
+        if (p.gravity_factor != 0.0f || p.can_move_diagonally || p.dispersion_rate != 0) add(pixel_behaviour::moves);
+        if (p.can_boil_water || p.is_corrosion_source || p.is_burn_source || p.is_ember_source) add(pixel_behaviour::reacts);
+        if (p.flammability > 0.0f) add(pixel_behaviour::burns);
+        if (p.power_type == pixel_power_type::source) add(pixel_behaviour::powers);
+        if (p.spontaneous_destroy > 0.0f) add(pixel_behaviour::decays);
+        if (p.always_awake) add(pixel_behaviour::wakes);
+        table[i] = mask;
+    }
+    return table;
+}();
+
+inline auto properties(pixel_type type) -> const pixel_properties&
+{
+    assert(std::to_underlying(type) < num_pixel_types);
+    return pixel_properties_table[std::to_underlying(type)];
+}
+
+// Returns the pixel_behaviour bits for the given type, zero for inert types like rock
+inline auto behaviour(pixel_type type) -> std::uint8_t
+{
+    assert(std::to_underlying(type) < num_pixel_types);
+    return pixel_behaviour_table[std::to_underlying(type)];
+}
+
+inline auto has_behaviour(std::uint8_t mask, pixel_behaviour b) -> bool
+{
+    return mask & std::to_underlying(b);
+}
+
 struct pixel
 {
-    pixel_type      type;
-    glm::vec4       colour;
-    glm::vec2       velocity;
-    std::bitset<64> flags;
+    pixel_type     type         = pixel_type::none;
+
+    // Which of the colour variants for this type to draw, see pixel_colour
+    std::uint8_t   colour       = 0;
+
+    // How many times this pixel has been scorched by explosions, each one darkens it
+    std::uint8_t   scorch       = 0;
+
+    pixel_flag_set flags        = {};
 
     // For conductors, this is the current power level
     // For power sources, it is a value between in [0, 5), with 5 being active
-    std::uint8_t    power = 0;
+    std::uint8_t   power        = 0;
+
+    // The world tick this pixel was last updated on, see pixel_world::tick
+    std::uint8_t   updated_tick = 0;
+
+    // Fixed point, see pack_velocity
+    glm::i8vec2    velocity     = {0, 0};
 
     static auto air()       -> pixel;
     static auto sand()      -> pixel;
@@ -126,10 +369,31 @@ struct pixel
     static auto relay()     -> pixel;
 };
 
-auto properties(const pixel& px) -> const pixel_properties&;
+static_assert(sizeof(pixel) == 8);
+
+inline auto properties(const pixel& px) -> const pixel_properties&
+{
+    return properties(px.type);
+}
+
+// Pixel velocities are stored in fixed point with this many steps per pixel per tick.
+// Twelve keeps whole pixels exact and gravity within a couple of percent of its true
+// value, while still allowing speeds of over ten pixels per tick.
+static constexpr auto velocity_scale = 12.0f;
+
+auto pack_velocity(glm::vec2 velocity) -> glm::i8vec2;
+auto unpack_velocity(glm::i8vec2 velocity) -> glm::vec2;
+
+// The number of colour variants each pixel type has
+static constexpr auto num_colour_variants = 16;
+
+auto pixel_colour(const pixel& px) -> glm::vec4;
+
+// Whether the colour variants of this type are randomly perturbed from its base colour
+auto has_colour_noise(pixel_type type) -> bool;
 
 auto serialise(auto& archive, pixel& px) -> void {
-    archive(px.type, px.colour, px.velocity, px.flags, px.power);
+    archive(px.type, px.colour, px.scorch, px.flags, px.power, px.velocity.x, px.velocity.y);
 }
 
 auto is_active_power_source(const pixel& px) -> bool;
@@ -0,0 +1,317 @@
+#include "pixel_cluster.hpp"
+#include "world.hpp"
+#include "utility.hpp"
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace sand {
+namespace {
+
+enum class fill_state : u8
+{
+    unvisited,
+    anchored,
+    detached,
+};
+
+auto is_cluster_pixel(const pixel_world& w, pixel_pos pos) -> bool
+{
+    const auto type = w.type(pos);
+    return type != pixel_type::none
+        && properties(type).phase == pixel_phase::solid
+        && !w.flags(pos).test(is_falling);
+}
+
+auto is_on_world_edge(const pixel_world& w, pixel_pos pos) -> bool
+{
+    return pos.x == 0 || pos.y == 0 || pos.x == w.width_in_pixels() - 1 || pos.y == w.height_in_pixels() - 1;
+}
+
+// An axis aligned block of cluster pixels, inclusive
+struct cluster_rect
+{
+    i32 min_x;
+    i32 max_x;
+    i32 min_y;
+    i32 max_y;
+};
+
+// Covers the pixels of a sprite with rectangles by taking the runs of each row and
+// extending them downwards while the row below has exactly the same run. This is far
+// from optimal but solid rock tends to come out as a handful of boxes.
+auto get_cluster_rects(const pixel_cluster_component& cluster) -> std::vector<cluster_rect>
+{
+    auto rects = std::vector<cluster_rect>{};
+    auto open = std::vector<cluster_rect>{};
+    auto next_open = std::vector<cluster_rect>{};
+
+    for (i32 y = 0; y != cluster.height + 1; ++y) {
+        next_open.clear();
+        for (i32 x = 0; y != cluster.height && x != cluster.width;) {
+            if (cluster.pixels[y * cluster.width + x].type == pixel_type::none) {
+                ++x;
+                continue;
+            }
+            const auto start = x;
+            while (x != cluster.width && cluster.pixels[y * cluster.width + x].type != pixel_type::none) {
+                ++x;
+            }
+
+            const auto it = std::ranges::find_if(open, [&](const cluster_rect& r) {
+                return r.min_x == start && r.max_x == x - 1;
+            });
+            if (it != open.end()) {
+                next_open.push_back({it->min_x, it->max_x, it->min_y, y});
+                open.erase(it);
+            } else {
+                next_open.push_back({start, x - 1, y, y});
+            }
+        }
+        rects.insert(rects.end(), open.begin(), open.end());
+        std::swap(open, next_open);
+    }
+    return rects;
+}
+
+auto create_pixel_cluster(level& l, const std::vector<pixel_pos>& members) -> void
+{
+    auto& w = l.pixels;
+
+    auto min = glm::ivec2{std::numeric_limits<i32>::max()};
+    auto max = glm::ivec2{std::numeric_limits<i32>::min()};
+    auto centroid = glm::vec2{0.0f, 0.0f};
+    for (const auto pos : members) {
+        min = glm::min(min, glm::ivec2{pos});
+        max = glm::max(max, glm::ivec2{pos});
+        centroid += glm::vec2{pos.x + 0.5f, pos.y + 0.5f};
+    }
+    centroid /= static_cast<float>(members.size());
+
+    const auto e = l.entities.create();
+    auto& cluster = l.entities.emplace<pixel_cluster_component>(e);
+    cluster.width = max.x - min.x + 1;
+    cluster.height = max.y - min.y + 1;
+    cluster.origin = centroid - glm::vec2{min};
+    cluster.pixels.resize(cluster.width * cluster.height, pixel::air());
+    for (const auto pos : members) {
+        const auto local = glm::ivec2{pos} - min;
+        cluster.pixels[local.y * cluster.width + local.x] = w[pos];
+        w.set(pos, pixel::air());
+    }
+
+    // The chunks may be asleep, so make sure their colliders are traced without the
+    // pixels that were just lifted out
+    const auto min_chunk = min / config::chunk_size;
+    const auto max_chunk = max / config::chunk_size;
+    for (i32 y = min_chunk.y; y <= max_chunk.y; ++y) {
+        for (i32 x = min_chunk.x; x <= max_chunk.x; ++x) {
+            invalidate_chunk_collider(l, chunk_pos{x, y});
+        }
+    }
+
+    auto& body_comp = l.entities.emplace<body_component>(e);
+    auto def = b2DefaultBodyDef();
+    def.type = b2_dynamicBody;
+    def.position = pixel_to_physics(centroid);
+    def.isEnabled = false;
+    body_comp.body = b2CreateBody(l.physics.world, &def);
+    b2Body_SetUserData(body_comp.body, to_user_data(e));
+
+    for (const auto& rect : get_cluster_rects(cluster)) {
+        const auto size = glm::vec2{rect.max_x - rect.min_x + 1, rect.max_y - rect.min_y + 1};
+        const auto centre = glm::vec2{rect.min_x, rect.min_y} + size / 2.0f - cluster.origin;
+        const auto box = b2MakeOffsetBox(
+            pixel_to_physics(size.x / 2.0f),
+            pixel_to_physics(size.y / 2.0f),
+            pixel_to_physics(centre),
+            b2MakeRot(0)
+        );
+
+        auto shape_def = b2DefaultShapeDef();
+        shape_def.density = 1.0f;
+        shape_def.material.friction = 1.0f;
+        const auto shape = b2CreatePolygonShape(body_comp.body, &shape_def, &box);
+        if (!b2Shape_IsValid(body_comp.body_fixture)) {
+            body_comp.body_fixture = shape;
+        }
+    }
+}
+
+// Writes the cluster into the air pixels it covers, sampling the sprite at the centre of
+// each world pixel so that rotated clusters don't come out full of holes. Pixels that
+// would land on something else are lost.
+auto write_back_pixel_cluster(pixel_world& w, const pixel_cluster_component& cluster, b2Transform transform) -> void
+{
+    const auto position = physics_to_pixel(transform.p);
+    const auto to_world = [&](glm::vec2 local) {
+        return position + glm::vec2{
+            transform.q.c * local.x - transform.q.s * local.y,
+            transform.q.s * local.x + transform.q.c * local.y
+        };
+    };
+
+    const auto size = glm::vec2{cluster.width, cluster.height};
+    const auto corners = std::array{
+        to_world(-cluster.origin),
+        to_world(glm::vec2{size.x, 0.0f} - cluster.origin),
+        to_world(glm::vec2{0.0f, size.y} - cluster.origin),
+        to_world(size - cluster.origin)
+    };
+    auto min = corners[0];
+    auto max = corners[0];
+    for (const auto corner : corners) {
+        min = glm::min(min, corner);
+        max = glm::max(max, corner);
+    }
+
+    const auto lower = glm::max(glm::ivec2{glm::floor(min)}, glm::ivec2{0, 0});
+    const auto upper = glm::min(glm::ivec2{glm::ceil(max)}, glm::ivec2{w.width_in_pixels() - 1, w.height_in_pixels() - 1});
+    for (i32 y = lower.y; y <= upper.y; ++y) {
+        for (i32 x = lower.x; x <= upper.x; ++x) {
+            const auto offset = glm::vec2{x + 0.5f, y + 0.5f} - position;
+            const auto local = cluster.origin + glm::vec2{
+                transform.q.c * offset.x + transform.q.s * offset.y,
+                -transform.q.s * offset.x + transform.q.c * offset.y
+            };
+            const auto sprite = glm::ivec2{glm::floor(local)};
+            if (sprite.x < 0 || sprite.y < 0 || sprite.x >= cluster.width || sprite.y >= cluster.height) continue;
+
+            const auto& p = cluster.pixels[sprite.y * cluster.width + sprite.x];
+            if (p.type != pixel_type::none && w.type({x, y}) == pixel_type::none) {
+                w.set({x, y}, p);
+            }
+        }
+    }
+}
+
+}
+
+auto detach_pixel_clusters(level& l) -> void
+{
+    auto& w = l.pixels;
+    const auto blasts = w.take_blasts();
+    if (blasts.empty()) return;
+
+    // Every group touching a blast is within this window if it is small enough to detach
+    auto min = glm::ivec2{std::numeric_limits<i32>::max()};
+    auto max = glm::ivec2{std::numeric_limits<i32>::min()};
+    for (const auto& b : blasts) {
+        min = glm::min(min, glm::ivec2{b.pos} - (b.radius + 1));
+        max = glm::max(max, glm::ivec2{b.pos} + (b.radius + 1));
+    }
+    const auto window_min = glm::max(min - max_cluster_extent, glm::ivec2{0, 0});
+    const auto window_max = glm::min(max + max_cluster_extent, glm::ivec2{w.width_in_pixels() - 1, w.height_in_pixels() - 1});
+    const auto window_width = window_max.x - window_min.x + 1;
+
+    const auto in_window = [&](pixel_pos pos) {
+        return window_min.x <= pos.x && pos.x <= window_max.x && window_min.y <= pos.y && pos.y <= window_max.y;
+    };
+    auto states = std::vector<fill_state>(window_width * (window_max.y - window_min.y + 1), fill_state::unvisited);
+    const auto state = [&](pixel_pos pos) -> fill_state& {
+        return states[(pos.y - window_min.y) * window_width + (pos.x - window_min.x)];
+    };
+
+    auto members = std::vector<pixel_pos>{};
+    auto stack = std::vector<pixel_pos>{};
+    const auto fill = [&](pixel_pos seed) {
+        members.clear();
+        stack.clear();
+        stack.push_back(seed);
+        state(seed) = fill_state::detached;
+
+        auto anchored = false;
+        while (!stack.empty() && !anchored) {
+            const auto curr = stack.back();
+            stack.pop_back();
+            members.push_back(curr);
+            anchored = is_on_world_edge(w, curr) || members.size() > max_cluster_pixels;
+
+            for (const auto offset : {glm::ivec2{1, 0}, glm::ivec2{-1, 0}, glm::ivec2{0, 1}, glm::ivec2{0, -1}}) {
+                const auto next = curr + offset;
+                if (!w.is_valid_pixel(next) || !is_cluster_pixel(w, next)) continue;
+                if (!in_window(next) || state(next) == fill_state::anchored) {
+                    anchored = true;
+                    continue;
+                }
+                if (state(next) == fill_state::unvisited) {
+                    state(next) = fill_state::detached;
+                    stack.push_back(next);
+                }
+            }
+        }
+
+        // The rest of the group is unexplored, so mark what was found so that any fill
+        // reaching it later knows it is attached too
+        if (anchored) {
+            for (const auto pos : members) state(pos) = fill_state::anchored;
+            for (const auto pos : stack) state(pos) = fill_state::anchored;
+        }
+        else if (members.size() >= min_cluster_pixels) {
+            create_pixel_cluster(l, members);
+        }
+    };
+
+    for (const auto& b : blasts) {
+        const auto lower = glm::max(glm::ivec2{b.pos} - (b.radius + 1), window_min);
+        const auto upper = glm::min(glm::ivec2{b.pos} + (b.radius + 1), window_max);
+        for (i32 y = lower.y; y <= upper.y; ++y) {
+            for (i32 x = lower.x; x <= upper.x; ++x) {
+                const auto pos = pixel_pos{x, y};
+                if (state(pos) == fill_state::unvisited && is_cluster_pixel(w, pos)) {
+                    fill(pos);
+                }
+            }
+        }
+    }
+}
+
+auto settle_pixel_clusters(level& l) -> void
+{
+    for (auto e : l.entities.view<pixel_cluster_component>()) {
+        auto& cluster = l.entities.get<pixel_cluster_component>(e);
+        const auto body = l.entities.get<body_component>(e).body;
+        if (!b2Body_IsEnabled(body)) continue;
+
+        const auto position = physics_to_pixel(b2Body_GetPosition(body));
+        if (position.y > l.pixels.height_in_pixels() + max_cluster_extent) {
+            l.entities.mark_for_death(e); // Fell out of the world
+            continue;
+        }
+
+        const auto speed = glm::length(physics_to_pixel(b2Body_GetLinearVelocity(body)));
+        const auto spin = glm::abs(b2Body_GetAngularVelocity(body));
+        if (!b2Body_IsAwake(body) || (speed < 1.0f && spin < 0.05f)) {
+            ++cluster.resting_updates;
+        } else {
+            cluster.resting_updates = 0;
+        }
+
+        if (cluster.resting_updates >= cluster_rest_updates) {
+            write_back_pixel_cluster(l.pixels, cluster, b2Body_GetTransform(body));
+            l.entities.mark_for_death(e);
+        }
+    }
+}
+
+auto enable_pixel_clusters(level& l) -> void
+{
+    for (auto e : l.entities.view<pixel_cluster_component>()) {
+        auto& cluster = l.entities.get<pixel_cluster_component>(e);
+        const auto body = l.entities.get<body_component>(e).body;
+        if (b2Body_IsEnabled(body)) continue;
+
+        // Clusters made this update only had their colliders queued just now
+        if (cluster.colliders_queued) {
+            b2Body_Enable(body);
+        } else {
+            cluster.colliders_queued = true;
+        }
+    }
+}
+
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include "common.hpp"
+#include "entity.hpp"
+
+#include <glm/glm.hpp>
+#include <box2d/box2d.h>
+
+namespace sand {
+
+struct level;
+
+// Explosions can cut solid pixels off from the rest of the world. Rather than leave
+// them hanging in the air, each group is lifted out of the pixel world and simulated
+// as a single rigid body, then written back once it comes to rest.
+
+// Groups larger than this, or reaching further than max_cluster_extent from the blast,
+// are assumed to still be attached to the world
+static constexpr i32 max_cluster_pixels = 4096;
+static constexpr i32 max_cluster_extent = 128;
+
+// Smaller groups are left where they are
+static constexpr i32 min_cluster_pixels = 4;
+
+// How many updates a cluster must barely move for before it is written back
+static constexpr i32 cluster_rest_updates = 30;
+
+// Finds the groups cut loose by the explosions since the last call and turns each one
+// into a pixel cluster entity
+auto detach_pixel_clusters(level& l) -> void;
+
+// Writes the clusters that have come to rest back into the world
+auto settle_pixel_clusters(level& l) -> void;
+
+// Clusters start with their bodies disabled, as the static colliders still cover the
+// pixels they were cut from until the rebuilt ones are swapped in on the next update.
+// Called after update_chunk_colliders to enable the clusters whose colliders are in.
+auto enable_pixel_clusters(level& l) -> void;
+
+// Calls callback(centre, pixel) for every pixel of a cluster, where centre is in pixel
+// space and follows the rotation of the body
+auto for_each_cluster_pixel(const registry& entities, entity e, auto&& callback) -> void
+{
+    const auto& cluster = entities.get<pixel_cluster_component>(e);
+    const auto transform = b2Body_GetTransform(entities.get<body_component>(e).body);
+    const auto position = physics_to_pixel(transform.p);
+    for (i32 y = 0; y != cluster.height; ++y) {
+        for (i32 x = 0; x != cluster.width; ++x) {
+            const auto& p = cluster.pixels[y * cluster.width + x];
+            if (p.type == pixel_type::none) continue;
+
+            const auto local = glm::vec2{x + 0.5f, y + 0.5f} - cluster.origin;
+            callback(position + glm::vec2{
+                transform.q.c * local.x - transform.q.s * local.y,
+                transform.q.s * local.x + transform.q.c * local.y
+            }, p);
+        }
+    }
+}
+
+}
@@ -0,0 +1,32 @@
+#include "random.hpp"
+
+#include <cmath>
+#include <numbers>
+#include <random>
+
+namespace sand {
+
+auto random_seed() -> std::uint64_t
+{
+    auto device = std::random_device{};
+    return (static_cast<std::uint64_t>(device()) << 32) | device();
+}
+
+auto random_from_circle(float radius) -> glm::ivec2
+{
+    const auto r = random_from_range(0.0f, radius);
+    const auto x = random_from_range(0.0f, 2.0f * std::numbers::pi_v<float>);
+    return { r * std::cos(x), r * std::sin(x) };
+}
+
+auto random_normal(float centre, float sd) -> float
+{
+    return std::normal_distribution(centre, sd)(thread_random_engine());
+}
+
+auto sign_flip() -> int
+{
+    return coin_flip() ? 1 : -1;
+}
+
+}
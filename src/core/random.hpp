@@ -0,0 +1,146 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+
+#include <glm/glm.hpp>
+
+namespace sand {
+
+// A xoshiro256** generator. The simulation draws several random numbers per pixel per
+// tick, so this is kept small and cheap: no distribution objects, floats are built
+// straight from the top bits, and coin flips are taken one bit at a time from a cached
+// word. Satisfies UniformRandomBitGenerator so it can still drive std distributions.
+class random_engine
+{
+    std::array<std::uint64_t, 4> d_state;
+    std::uint64_t                d_bits      = 0;
+    int                          d_bits_left = 0;
+
+    static constexpr auto rotl(std::uint64_t x, int k) -> std::uint64_t
+    {
+        return (x << k) | (x >> (64 - k));
+    }
+
+public:
+    using result_type = std::uint64_t;
+
+    explicit random_engine(std::uint64_t seed_value) { seed(seed_value); }
+
+    // Expands the seed with splitmix64, as recommended for xoshiro
+    auto seed(std::uint64_t seed_value) -> void
+    {
+        for (auto& s : d_state) {
+            seed_value += 0x9e3779b97f4a7c15;
+            auto z = seed_value;
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+            s = z ^ (z >> 31);
+        }
+        d_bits = 0;
+        d_bits_left = 0;
+    }
+
+    auto next() -> std::uint64_t
+    {
+        const auto result = rotl(d_state[1] * 5, 7) * 9;
+        const auto t = d_state[1] << 17;
+        d_state[2] ^= d_state[0];
+        d_state[3] ^= d_state[1];
+        d_state[1] ^= d_state[2];
+        d_state[0] ^= d_state[3];
+        d_state[2] ^= t;
+        d_state[3] = rotl(d_state[3], 45);
+        return result;
+    }
+
+    auto coin_flip() -> bool
+    {
+        if (d_bits_left == 0) {
+            d_bits = next();
+            d_bits_left = 64;
+        }
+        const auto bit = d_bits & 1;
+        d_bits >>= 1;
+        --d_bits_left;
+        return bit;
+    }
+
+    // Uniform in [0, 1), using the top 24 bits so every value is exactly representable
+    auto unit() -> float
+    {
+        return static_cast<float>(next() >> 40) * 0x1.0p-24f;
+    }
+
+    // Uniform in [min, max)
+    auto range(float min, float max) -> float
+    {
+        return min + (max - min) * unit();
+    }
+
+    // Uniform in [min, max], via a multiply rather than a modulo. The bias is at most
+    // (max - min + 1) / 2^32, which is far below anything the simulation can notice.
+    auto range(int min, int max) -> int
+    {
+        const auto span = static_cast<std::uint64_t>(static_cast<std::int64_t>(max) - min + 1);
+        return min + static_cast<int>(((next() >> 32) * span) >> 32);
+    }
+
+    auto operator()() -> result_type { return next(); }
+    static constexpr auto min() -> result_type { return 0; }
+    static constexpr auto max() -> result_type { return std::numeric_limits<result_type>::max(); }
+};
+
+// Returns a seed taken from std::random_device
+auto random_seed() -> std::uint64_t;
+
+// Combines a seed with a value to give the seed of an independent stream, so that for
+// example every chunk on every tick can draw from its own reproducible sequence.
+constexpr auto mix_seed(std::uint64_t seed, std::uint64_t value) -> std::uint64_t
+{
+    auto z = seed ^ (value + 0x9e3779b97f4a7c15 + (seed << 6) + (seed >> 2));
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+}
+
+// Each thread has its own engine, seeded separately, so that workers stepping chunks in
+// parallel never contend on shared state or produce the same sequence.
+inline auto thread_random_engine() -> random_engine&
+{
+    thread_local auto engine = random_engine{random_seed()};
+    return engine;
+}
+
+inline auto random_from_range(float min, float max) -> float
+{
+    return thread_random_engine().range(min, max);
+}
+
+inline auto random_from_range(int min, int max) -> int
+{
+    return thread_random_engine().range(min, max);
+}
+
+inline auto coin_flip() -> bool
+{
+    return thread_random_engine().coin_flip();
+}
+
+inline auto random_unit() -> float // Same as random_from_range(0.0f, 1.0f)
+{
+    return thread_random_engine().unit();
+}
+
+auto random_from_circle(float radius) -> glm::ivec2;
+auto random_normal(float centre, float sd) -> float;
+auto sign_flip() -> int;
+
+template <typename Elements>
+auto random_element(const Elements& elements)
+{
+    return elements[random_from_range(0, static_cast<int>(std::ssize(elements)) - 1)];
+}
+
+}
@@ -111,17 +111,17 @@ auto renderer::update(const level& world) -> void
 
     auto buffer = std::array<glm::vec4, config::chunk_size * config::chunk_size> {};
 
-    for (i32 cx = 0; cx != world.pixels.width_in_chunks(); ++cx) {
-        for (i32 cy = 0; cy != world.pixels.height_in_chunks(); ++cy) {
+    for (i32 cy = 0; cy != world.pixels.height_in_chunks(); ++cy) {
+        for (i32 cx = 0; cx != world.pixels.width_in_chunks(); ++cx) {
             const auto cpos = chunk_pos{cx, cy};
             const auto chunk = world.pixels[cpos];
-            if (!chunk.should_step) continue;
+            if (!chunk.should_step && world.pixels.active_pixels(cpos).empty()) continue;
             
             const auto top_left = get_chunk_top_left(cpos);
-            for (i32 x = 0; x != config::chunk_size; ++x) {
-                for (i32 y = 0; y != config::chunk_size; ++y) {
+            for (i32 y = 0; y != config::chunk_size; ++y) {
+                for (i32 x = 0; x != config::chunk_size; ++x) {
                     const auto world_coord = top_left + glm::ivec2{x, y};
-                    const auto& pixel = world.pixels[world_coord];
+                    const auto pixel = world.pixels[world_coord];
                     const auto& props = properties(pixel);
                     
                     auto& colour = buffer[x + config::chunk_size * y];
@@ -130,12 +130,12 @@ auto renderer::update(const level& world) -> void
                     }
                     else if (props.power_type == pixel_power_type::source) {
                         const auto a = from_hex(0x000000); // black
-                        const auto b = pixel.colour;
+                        const auto b = pixel_colour(pixel);
                         const auto t = static_cast<float>(pixel.power) / props.power_max;
                         colour = sand::lerp(a, b, t);
                     }
                     else if (props.power_type == pixel_power_type::conductor) {
-                        const auto a = pixel.colour;
+                        const auto a = pixel_colour(pixel);
                         const auto b = sand::random_element(electricity_colours);
                         const auto t = static_cast<float>(pixel.power) / props.power_max;
                         colour = sand::lerp(a, b, t);
@@ -144,7 +144,7 @@ auto renderer::update(const level& world) -> void
                         colour = {0.0, 0.0, 0.0, 0.0};
                     }
                     else {
-                        colour = pixel.colour;
+                        colour = pixel_colour(pixel);
                     }
                 }
             }
@@ -9,7 +9,96 @@
 
 #include <cereal/archives/binary.hpp>
 
+#include <algorithm>
+#include <bitset>
+#include <cmath>
+#include <limits>
+
 namespace sand {
+namespace {
+
+// The layout of pixels in saves written before they were packed into 8 bytes
+struct legacy_pixel
+{
+    pixel_type      type;
+    glm::vec4       colour;
+    glm::vec2       velocity;
+    std::bitset<64> flags;
+    std::uint8_t    power;
+
+    auto serialise(auto& archive) -> void
+    {
+        archive(type, colour, velocity, flags, power);
+    }
+};
+
+struct legacy_world_save
+{
+    std::vector<legacy_pixel> pixels;
+    std::size_t               width;
+    std::size_t               height;
+    glm::ivec2                spawn_point;
+
+    auto serialise(auto& archive) -> void
+    {
+        archive(pixels, width, height, spawn_point);
+    }
+};
+
+auto distance_squared(glm::vec4 a, glm::vec4 b) -> float
+{
+    const auto d = a - b;
+    return d.x * d.x + d.y * d.y + d.z * d.z;
+}
+
+auto from_legacy(const legacy_pixel& old) -> pixel
+{
+    auto px = pixel{ .type = old.type, .power = old.power };
+    px.velocity = pack_velocity(old.velocity);
+    px.flags.set(is_falling, old.flags[1]);
+    px.flags.set(is_burning, old.flags[2]);
+
+    // Scorching used to scale the whole colour, alpha included, by 0.8. Noise used to
+    // add one to the alpha as well, so those types started from an alpha of two.
+    const auto base_alpha = has_colour_noise(old.type) ? 2.0f : 1.0f;
+    if (old.type != pixel_type::none && 0.0f < old.colour.w && old.colour.w < base_alpha) {
+        const auto scorch = std::round(std::log(old.colour.w / base_alpha) / std::log(0.8f));
+        px.scorch = static_cast<std::uint8_t>(std::clamp(scorch, 0.0f, 255.0f));
+    }
+
+    // Pick whichever colour variant is closest to the stored colour
+    auto best = std::numeric_limits<float>::max();
+    for (int variant = 0; variant != num_colour_variants; ++variant) {
+        auto candidate = px;
+        candidate.colour = static_cast<std::uint8_t>(variant);
+        const auto dist = distance_squared(pixel_colour(candidate), old.colour);
+        if (dist < best) {
+            best = dist;
+            px.colour = candidate.colour;
+        }
+    }
+    return px;
+}
+
+auto load_legacy_save(std::istream& file) -> world_save
+{
+    auto archive = cereal::BinaryInputArchive{file};
+    auto legacy = legacy_world_save{};
+    archive(legacy);
+
+    auto save = world_save{
+        .width = legacy.width,
+        .height = legacy.height,
+        .spawn_point = legacy.spawn_point
+    };
+    save.pixels.reserve(legacy.pixels.size());
+    for (const auto& old : legacy.pixels) {
+        save.pixels.push_back(from_legacy(old));
+    }
+    return save;
+}
+
+}
 
 auto new_level(int chunks_width, int chunks_height) -> level
 {
@@ -28,6 +117,7 @@ auto save_level(const std::string& file_path, const sand::level& w) -> void
 {
     auto file = std::ofstream{file_path, std::ios::binary};
     auto archive = cereal::BinaryOutputArchive{file};
+    archive(world_save_magic);
 
     auto save = sand::world_save{
         .pixels = w.pixels.pixels(),
@@ -42,10 +132,19 @@ auto save_level(const std::string& file_path, const sand::level& w) -> void
 auto load_level(const std::string& file_path) -> level
 {
     auto file = std::ifstream{file_path, std::ios::binary};
-    auto archive = cereal::BinaryInputArchive{file};
+
+    auto magic = u64{0};
+    file.read(reinterpret_cast<char*>(&magic), sizeof(magic));
 
     auto save = sand::world_save{};
-    archive(save);
+    if (magic == world_save_magic) {
+        auto archive = cereal::BinaryInputArchive{file};
+        archive(save);
+    } else {
+        file.clear();
+        file.seekg(0);
+        save = load_legacy_save(file);
+    }
 
     // TODO: Store the sizes as u32's in the file
     return {
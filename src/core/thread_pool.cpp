@@ -0,0 +1,142 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <latch>
+
+namespace sand {
+namespace {
+
+thread_local std::size_t current_thread_index = 0;
+
+}
+
+thread_pool::thread_pool(std::size_t num_threads)
+{
+    d_threads.reserve(num_threads);
+    for (std::size_t i = 0; i != num_threads; ++i) {
+        d_threads.emplace_back([this, i] {
+            current_thread_index = i + 1;
+            worker_loop();
+        });
+    }
+}
+
+thread_pool::~thread_pool()
+{
+    {
+        const auto lock = std::unique_lock{d_mutex};
+        d_stopping = true;
+    }
+    d_cv.notify_all();
+    d_threads.clear(); // jthreads join on destruction
+}
+
+auto thread_pool::worker_loop() -> void
+{
+    while (true) {
+        auto task = std::move_only_function<void()>{};
+        {
+            auto lock = std::unique_lock{d_mutex};
+            d_cv.wait(lock, [&] { return d_stopping || d_next_task != d_tasks.size(); });
+            if (d_next_task == d_tasks.size()) return; // only happens when stopping
+            task = pop();
+        }
+        task();
+    }
+}
+
+auto thread_pool::push(std::move_only_function<void()> task) -> void
+{
+    // Drop the finished tasks from the front once they make up half the queue, so a
+    // queue that never quite empties doesn't grow forever
+    if (d_next_task > 0 && d_next_task * 2 >= d_tasks.size()) {
+        d_tasks.erase(d_tasks.begin(), d_tasks.begin() + d_next_task);
+        d_next_task = 0;
+    }
+    d_tasks.push_back(std::move(task));
+}
+
+auto thread_pool::pop() -> std::move_only_function<void()>
+{
+    auto task = std::move(d_tasks[d_next_task++]);
+    if (d_next_task == d_tasks.size()) {
+        d_tasks.clear();
+        d_next_task = 0;
+    }
+    return task;
+}
+
+auto thread_pool::submit(std::move_only_function<void()> task) -> std::future<void>
+{
+    auto packaged = std::packaged_task<void()>{std::move(task)};
+    auto future = packaged.get_future();
+    post(std::move(packaged));
+    return future;
+}
+
+auto thread_pool::post(std::move_only_function<void()> task) -> void
+{
+    // With no workers, nothing would ever pick the task up
+    if (d_threads.empty()) {
+        task();
+        return;
+    }
+
+    {
+        const auto lock = std::unique_lock{d_mutex};
+        push(std::move(task));
+    }
+    d_cv.notify_one();
+}
+
+auto thread_pool::run_pending() -> bool
+{
+    auto task = std::move_only_function<void()>{};
+    {
+        const auto lock = std::unique_lock{d_mutex};
+        if (d_next_task == d_tasks.size()) return false;
+        task = pop();
+    }
+    task();
+    return true;
+}
+
+auto thread_pool::thread_index() -> std::size_t
+{
+    return current_thread_index;
+}
+
+auto thread_pool::parallel_for(std::size_t count, const std::function<void(std::size_t)>& fn) -> void
+{
+    if (count == 0) return;
+
+    auto next = std::atomic<std::size_t>{0};
+    const auto run = [&] {
+        for (auto i = next.fetch_add(1); i < count; i = next.fetch_add(1)) {
+            fn(i);
+        }
+    };
+
+    // The calling thread is one of the workers, so only hand out the rest
+    const auto helpers = std::min(size(), count - 1);
+    auto done = std::latch{static_cast<std::ptrdiff_t>(helpers)};
+    {
+        const auto lock = std::unique_lock{d_mutex};
+        for (std::size_t i = 0; i != helpers; ++i) {
+            push([&] { run(); done.count_down(); });
+        }
+    }
+    d_cv.notify_all();
+
+    run();
+    done.wait();
+}
+
+auto global_thread_pool() -> thread_pool&
+{
+    static auto pool = thread_pool{std::max(1u, std::thread::hardware_concurrency()) - 1};
+    return pool;
+}
+
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace sand {
+
+// A fixed set of worker threads. There is a single pool for the whole process (see
+// global_thread_pool) so that the different parallel parts of the engine share the
+// same threads rather than each oversubscribing the machine.
+class thread_pool
+{
+    std::vector<std::jthread>                    d_threads;
+    std::mutex                                   d_mutex;
+    std::condition_variable                      d_cv;
+    bool                                         d_stopping = false;
+
+    // Tasks waiting to run are those from d_next_task onwards. The vector is reused
+    // rather than shrunk, so queueing tasks doesn't allocate once it has grown.
+    std::vector<std::move_only_function<void()>> d_tasks;
+    std::size_t                                  d_next_task = 0;
+
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+
+    auto worker_loop() -> void;
+    auto push(std::move_only_function<void()> task) -> void; // Requires d_mutex
+    auto pop() -> std::move_only_function<void()>;           // Requires d_mutex
+
+public:
+    explicit thread_pool(std::size_t num_threads);
+    ~thread_pool();
+
+    auto size() const -> std::size_t { return d_threads.size(); }
+
+    // Runs the task on a worker. A pool with no workers runs it before returning.
+    auto submit(std::move_only_function<void()> task) -> std::future<void>;
+
+    // As submit, but with no future, so nothing is allocated for the result. The task
+    // has to signal its own completion.
+    auto post(std::move_only_function<void()> task) -> void;
+
+    // Takes the oldest waiting task and runs it on the calling thread, returning false if
+    // there was none. Lets a thread that is waiting on tasks help with them.
+    auto run_pending() -> bool;
+
+    // The calling thread's position among the workers counting from 1, or 0 for a thread
+    // that isn't a worker. No two threads running at once share an index.
+    static auto thread_index() -> std::size_t;
+
+    // Calls fn(i) for every i in [0, count), spreading the calls over the workers. The
+    // calling thread also takes part and this only returns once every call is done.
+    // Must not be called from inside a task running on this pool.
+    auto parallel_for(std::size_t count, const std::function<void(std::size_t)>& fn) -> void;
+};
+
+auto global_thread_pool() -> thread_pool&;
+
+}
@@ -2,17 +2,28 @@
 #include "common.hpp"
 #include "world.hpp"
 #include "utility.hpp"
+#include "thread_pool.hpp"
 
-#include <bitset>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <type_traits>
+#include <utility>
 #include <vector>
 #include <print>
 
+// The SSSE3 kernel is compiled for that target on its own and only called once the
+// CPU has been checked for it, so the rest of the file stays on the baseline target
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define SAND_STATIC_ROW_SSSE3
+#include <tmmintrin.h>
+#endif
+
 #include <glm/glm.hpp>
 
 namespace sand {
 
-using chunk_static_pixels = std::bitset<sand::config::chunk_size * sand::config::chunk_size>;
-
 auto is_static_pixel(
     pixel_pos top_left,
     const pixel_world& w,
@@ -21,120 +32,144 @@ auto is_static_pixel(
     if (!(top_left.x <= pos.x && pos.x < top_left.x + sand::config::chunk_size) || !(top_left.y <= pos.y && pos.y < top_left.y + sand::config::chunk_size)) return false;
     
     if (!w.is_valid_pixel(pos)) return false;
-    const auto& pixel = w[pos];
-    const auto& props = sand::properties(pixel);
-    return pixel.type != sand::pixel_type::none
-        && props.phase == sand::pixel_phase::solid
-        && !pixel.flags.test(sand::pixel_flags::is_falling);
+    const auto type = w.type(pos);
+    return type != sand::pixel_type::none
+        && sand::properties(type).phase == sand::pixel_phase::solid
+        && !w.flags(pos).test(sand::pixel_flags::is_falling);
 }
 
-auto is_static_boundary(
-    pixel_pos top_left,
-    const pixel_world& w,
-    pixel_pos A, glm::ivec2 offset) -> bool
-{
-    assert(glm::abs(offset.x) + glm::abs(offset.y) == 1);
-    const auto static_a = is_static_pixel(top_left, w, A);
-    const auto static_b = is_static_pixel(top_left, w, A + offset);
-    return (!static_a && static_b) || (!static_b && static_a);
-}
+// 0xff for the types that are static when not falling, padded to 32 entries so that it
+// splits into two 16 byte tables for pshufb
+static_assert(num_pixel_types <= 32);
+alignas(16) static constexpr auto static_type_table = [] {
+    auto table = std::array<u8, 32>{};
+    for (std::size_t i = 0; i != num_pixel_types; ++i) {
+        const auto is_solid = pixel_properties_table[i].phase == pixel_phase::solid;
+        table[i] = (i != std::to_underlying(pixel_type::none) && is_solid) ? 0xff : 0x00;
+    }
+    return table;
+}();
 
-auto is_along_boundary(
-    pixel_pos top_left,
-    const pixel_world& w,
-    pixel_pos curr, pixel_pos next) -> bool
-{
-    const auto offset = next - curr;
-    assert(glm::abs(offset.x) + glm::abs(offset.y) == 1);
-    if (offset == up)    return is_static_boundary(top_left, w, next, left);
-    if (offset == down)  return is_static_boundary(top_left, w, curr, left);
-    if (offset == left)  return is_static_boundary(top_left, w, next, up);
-    if (offset == right) return is_static_boundary(top_left, w, curr, up);
-    std::unreachable();
-}
+// The flag planes are read as plain bytes
+static_assert(sizeof(pixel_flag_set) == 1 && std::is_standard_layout_v<pixel_flag_set>);
 
-auto is_boundary_cross(
-    pixel_pos top_left,
-    const pixel_world& w,
-    pixel_pos curr) -> bool
+// Returns the static pixels of one row of a chunk, bit x being pixel x
+auto get_static_row_scalar(const pixel_type* types, const pixel_flag_set* flags) -> u64
 {
-    const auto tl = is_static_pixel(top_left, w, curr + left + up);
-    const auto tr = is_static_pixel(top_left, w, curr + up);
-    const auto bl = is_static_pixel(top_left, w, curr + left);
-    const auto br = is_static_pixel(top_left, w, curr);
-    return (tl == br) && (bl == tr) && (tl != tr);
+    const auto* flag_bits = reinterpret_cast<const u8*>(flags);
+    auto row = u64{0};
+    for (i32 x = 0; x != config::chunk_size; ++x) {
+        const auto is_solid = static_type_table[std::to_underlying(types[x])] & 1;
+        const auto is_falling_bit = (flag_bits[x] >> is_falling) & 1;
+        row |= u64(is_solid & ~is_falling_bit) << x;
+    }
+    return row;
 }
 
-auto is_valid_step(
-    pixel_pos top_left,
-    const pixel_world& w,
-    pixel_pos prev,
-    pixel_pos curr,
-    pixel_pos next) -> bool
+#ifdef SAND_STATIC_ROW_SSSE3
+__attribute__((target("ssse3")))
+auto get_static_row_ssse3(const pixel_type* types, const pixel_flag_set* flags) -> u64
 {
-    if (!is_along_boundary(top_left, w, curr, next)) return false;
-    if (prev.x == 0 && prev.y == 0) return true;
-    if (prev == next) return false;
+    // Types index the table with their low four bits, and bit four picks the half
+    const auto low_table = _mm_load_si128(reinterpret_cast<const __m128i*>(static_type_table.data()));
+    const auto high_table = _mm_load_si128(reinterpret_cast<const __m128i*>(static_type_table.data() + 16));
+    const auto low_bits = _mm_set1_epi8(0x0f);
+    const auto high_bit = _mm_set1_epi8(0x10);
+    const auto falling_bit = _mm_set1_epi8(1 << is_falling);
 
-    if (!is_boundary_cross(top_left, w, curr)) return true;
+    auto row = u64{0};
+    for (i32 x = 0; x != config::chunk_size; x += 16) {
+        const auto t = _mm_loadu_si128(reinterpret_cast<const __m128i*>(types + x));
+        const auto f = _mm_loadu_si128(reinterpret_cast<const __m128i*>(flags + x));
 
-    // in a straight line going over the cross
-    if ((prev.x == curr.x && curr.x == next.x) || (prev.y == curr.y && curr.y == next.y)) {
-        return false;
-    }
+        const auto index = _mm_and_si128(t, low_bits);
+        const auto is_high = _mm_cmpeq_epi8(_mm_and_si128(t, high_bit), high_bit);
+        const auto is_solid = _mm_or_si128(
+            _mm_andnot_si128(is_high, _mm_shuffle_epi8(low_table, index)),
+            _mm_and_si128(is_high, _mm_shuffle_epi8(high_table, index))
+        );
+        const auto not_falling = _mm_cmpeq_epi8(_mm_and_si128(f, falling_bit), _mm_setzero_si128());
 
-    // curving through the cross must go round an actual pixel
-    const auto pixel = pixel_pos{
-        std::min({prev.x, curr.x, next.x}),
-        std::min({prev.y, curr.y, next.y})
-    };
-    return is_static_pixel(top_left, w, pixel);
+        const auto bits = _mm_movemask_epi8(_mm_and_si128(is_solid, not_falling));
+        row |= u64{static_cast<u16>(bits)} << x;
+    }
+    return row;
 }
+#endif
 
-auto get_boundary(
-    pixel_pos top_left,
-    const pixel_world& w,
-    pixel_pos start) -> std::vector<pixel_pos>
+using static_row_function = u64(*)(const pixel_type*, const pixel_flag_set*);
+
+// Picked once, the first time a mask is built
+auto choose_static_row_function() -> static_row_function
 {
-    auto ret = std::vector<pixel_pos>{};
-    auto current = start;
-    while (is_static_pixel(top_left, w, current + up)) { current = current + up; }
-    ret.push_back(current);
-    
-    // Find second point
-    bool found_second = false;
-    for (const auto offset : offsets) {
-        const auto neigh = current + offset;
-        if (is_valid_step(top_left, w, {0, 0}, current, neigh)) {
-            current = neigh;
-            ret.push_back(current);
-            found_second = true;
-            break;
-        }
-    }
-    if (!found_second) {
-        return {};
+#ifdef SAND_STATIC_ROW_SSSE3
+    if (__builtin_cpu_supports("ssse3")) {
+        return get_static_row_ssse3;
     }
+#endif
+    return get_static_row_scalar;
+}
 
-    // continue until we get back to the start
-    while (current != ret.front()) {
-        bool found = false;
-        for (const auto offset : offsets) {
-            const auto neigh = current + offset;
-            if (is_valid_step(top_left, w, ret.rbegin()[1], current, neigh)) {
-                current = neigh;
-                found = true;
-                ret.push_back(current);
-                break;
-            }
+// Boundaries are traced along the lattice of pixel corners, where corner (x, y) is the
+// top left of pixel (x, y). They always keep the static pixels on their right, which
+// is the side Box2D chains collide on, so outer loops run clockwise on screen and
+// holes run anticlockwise.
+
+// Indexed by direction: right, down, left, up
+static constexpr auto directions = std::array{
+    glm::ivec2{1, 0}, glm::ivec2{0, 1}, glm::ivec2{-1, 0}, glm::ivec2{0, -1}
+};
+
+// Marching squares cases are formed from the four pixels around a corner
+enum corner_bits : u8
+{
+    top_left_bit     = 1 << 0,
+    top_right_bit    = 1 << 1,
+    bottom_right_bit = 1 << 2,
+    bottom_left_bit  = 1 << 3,
+};
+
+// For each of the 16 cases and each direction of arrival, the direction the boundary
+// leaves the corner in, or -1 if there is no boundary. The two saddle cases have two
+// boundaries passing through, and these are paired up so that the boundary turns round
+// the pixel it is following, which keeps diagonally touching pixels as separate shapes.
+static constexpr auto marching_squares_table = [] {
+    auto table = std::array<std::array<i8, 4>, 16>{};
+    for (u8 c = 0; c != 16; ++c) {
+        const bool tl = c & top_left_bit;
+        const bool tr = c & top_right_bit;
+        const bool br = c & bottom_right_bit;
+        const bool bl = c & bottom_left_bit;
+
+        auto out = i8{-1};
+        if (br && !tr) out = 0;
+        if (bl && !br) out = 1;
+        if (tl && !bl) out = 2;
+        if (tr && !tl) out = 3;
+        table[c] = {out, out, out, out};
+
+        if (c == (top_left_bit | bottom_right_bit)) {
+            table[c][1] = 2; // arriving downwards round the top left, so turn left
+            table[c][3] = 0; // arriving upwards round the bottom right, so turn right
         }
-        if (!found) {
-            return ret; // hmm
+        else if (c == (top_right_bit | bottom_left_bit)) {
+            table[c][0] = 1; // arriving rightwards round the bottom left, so turn down
+            table[c][2] = 3; // arriving leftwards round the top right, so turn up
         }
     }
+    return table;
+}();
 
-    return ret;
-}
+// The directions a boundary can leave a corner in for each case, as a bitmask
+static constexpr auto marching_squares_exits = [] {
+    auto exits = std::array<u8, 16>{};
+    for (std::size_t c = 0; c != 16; ++c) {
+        for (const auto dir : marching_squares_table[c]) {
+            if (dir != -1) exits[c] |= 1 << dir;
+        }
+    }
+    return exits;
+}();
 
 auto cross(glm::ivec2 a, glm::ivec2 b) -> float
 {
@@ -177,107 +212,426 @@ auto ramer_douglas_puecker(std::span<const pixel_pos> points, float epsilon, std
     }
 }
 
-auto calc_boundary(
-    pixel_pos top_left,
-    const pixel_world& w,
-    pixel_pos start,
-    float epsilon) -> std::vector<pixel_pos>
+auto get_static_pixels(const pixel_world& w, chunk_pos pos) -> chunk_static_pixels
 {
-    const auto points = get_boundary(top_left, w, start);
-    if (epsilon == 0.0f) {
-        return points;
+    const auto types = w.chunk_types(pos);
+    const auto flags = w.chunk_flags(pos);
+
+    static const auto get_static_row = choose_static_row_function();
+
+    auto chunk_pixels = chunk_static_pixels{};
+    for (i32 y = 0; y != config::chunk_size; ++y) {
+        const auto offset = y * config::chunk_size;
+        chunk_pixels.rows[y] = get_static_row(types.data() + offset, flags.data() + offset);
     }
-    auto simplified = std::vector<pixel_pos>{};
-    ramer_douglas_puecker(points, epsilon, simplified);
-    return simplified;
+    return chunk_pixels;
 }
 
-auto flood_remove(chunk_static_pixels& pixels, glm::ivec2 offset) -> void
+auto get_static_pixels_per_pixel(const pixel_world& w, chunk_pos pos) -> chunk_static_pixels
 {
-    const auto is_valid = [](const glm::ivec2 p) {
-        return 0 <= p.x && p.x < sand::config::chunk_size && 0 <= p.y && p.y < sand::config::chunk_size;
-    };
+    const auto top_left = get_chunk_top_left(pos);
+    auto chunk_pixels = chunk_static_pixels{};
+    for (int y = 0; y != sand::config::chunk_size; ++y) {
+        for (int x = 0; x != sand::config::chunk_size; ++x) {
+            if (is_static_pixel(top_left, w, top_left + glm::ivec2{x, y})) {
+                chunk_pixels.rows[y] |= u64{1} << x;
+            }
+        }
+    }
+    return chunk_pixels;
+}
 
-    const auto to_index = [](const glm::ivec2 p) {
-        return p.y * sand::config::chunk_size + p.x;
+// Traces every boundary of the static pixels of a width by height area in a single
+// pass, including the boundaries of holes, and adds each to the chains once
+// simplified. is_static is only called for pixels inside the area.
+template <typename IsStatic>
+auto collider_builder::trace(i32 width, i32 height, IsStatic&& is_static_in_area, pixel_pos top_left, collider_chains& out) -> void
+{
+    const auto is_static = [&](int x, int y) {
+        return 0 <= x && x < width && 0 <= y && y < height && is_static_in_area(x, y);
     };
 
-    std::vector<glm::ivec2> to_visit;
-    to_visit.push_back(offset);
-    while (!to_visit.empty()) {
-        const auto curr = to_visit.back();
-        to_visit.pop_back();
-        pixels.reset(to_index(curr));
-        for (const auto offset : offsets) {
-            const auto neigh = curr + offset;
-            if (is_valid(neigh) && pixels.test(to_index(neigh))) {
-                to_visit.push_back(neigh);
+    const auto lattice_width = width + 1;
+    const auto lattice_height = height + 1;
+    const auto lattice_size = lattice_width * lattice_height;
+
+    d_cases.resize(lattice_size);
+    for (int y = 0; y != lattice_height; ++y) {
+        for (int x = 0; x != lattice_width; ++x) {
+            d_cases[y * lattice_width + x] = (is_static(x - 1, y - 1) ? top_left_bit : 0)
+                                          | (is_static(x, y - 1)     ? top_right_bit : 0)
+                                          | (is_static(x, y)         ? bottom_right_bit : 0)
+                                          | (is_static(x - 1, y)     ? bottom_left_bit : 0);
+        }
+    }
+
+    // The directions each corner has already been left in
+    d_visited.assign(lattice_size, 0);
+
+    out.clear();
+    for (int y = 0; y != lattice_height; ++y) {
+        for (int x = 0; x != lattice_width; ++x) {
+            const auto start = y * lattice_width + x;
+            auto remaining = marching_squares_exits[d_cases[start]] & ~d_visited[start];
+            while (remaining) {
+                // Each loop is traced in world space, with the first point repeated at the end
+                d_boundary.clear();
+                auto curr = glm::ivec2{x, y};
+                auto dir = std::countr_zero(static_cast<unsigned>(remaining));
+                while (true) {
+                    const auto index = curr.y * lattice_width + curr.x;
+                    d_visited[index] |= 1 << dir;
+                    d_boundary.push_back(top_left + curr);
+                    curr += directions[dir];
+
+                    const auto next = curr.y * lattice_width + curr.x;
+                    dir = marching_squares_table[d_cases[next]][dir];
+                    assert(dir != -1);
+                    if (d_visited[next] & (1 << dir)) break;
+                }
+                d_boundary.push_back(d_boundary.front());
+                remaining = marching_squares_exits[d_cases[start]] & ~d_visited[start];
+
+                d_simplified.clear();
+                ramer_douglas_puecker(d_boundary, 1.5f, d_simplified);
+                if (d_simplified.size() > 3) { // If there's only a small group, dont bother
+                    for (const auto pos : d_simplified) {
+                        out.points.push_back(pixel_to_physics(pos));
+                    }
+                    out.loop_ends.push_back(out.points.size());
+                }
             }
         }
     }
 }
 
-auto get_start_pixel_offset(const chunk_static_pixels& pixels) -> glm::ivec2
+auto collider_builder::build_chunk(const chunk_static_pixels& pixels, pixel_pos top_left, collider_chains& out) -> void
+{
+    const auto is_static = [&](int x, int y) {
+        return pixels.test(x, y);
+    };
+    trace(config::chunk_size, config::chunk_size, is_static, top_left, out);
+}
+
+auto collider_builder::build_island(
+    std::span<const std::pair<chunk_pos, chunk_static_pixels>> chunks,
+    island_pos pos,
+    collider_chains& out
+) -> void
+{
+    const auto first_chunk = chunk_pos{pos.x * island_size, pos.y * island_size};
+
+    // The chunks that aren't merged are left out, as they have their own bodies
+    auto masks = std::array<const chunk_static_pixels*, island_size * island_size>{};
+    for (const auto& [chunk, mask] : chunks) {
+        masks[(chunk.y - first_chunk.y) * island_size + (chunk.x - first_chunk.x)] = &mask;
+    }
+
+    const auto is_static = [&](int x, int y) {
+        const auto* mask = masks[(y / config::chunk_size) * island_size + x / config::chunk_size];
+        return mask && mask->test(x % config::chunk_size, y % config::chunk_size);
+    };
+    const auto size = island_size * config::chunk_size;
+    trace(size, size, is_static, get_chunk_top_left(first_chunk), out);
+}
+
+auto thread_collider_builder() -> collider_builder&
+{
+    thread_local auto builder = collider_builder{};
+    return builder;
+}
+
+auto build_chunk_collider(const chunk_static_pixels& pixels, pixel_pos top_left, collider_chains& out) -> void
+{
+    thread_collider_builder().build_chunk(pixels, top_left, out);
+}
+
+auto get_island(chunk_pos pos) -> island_pos
+{
+    // Chunk positions are never negative, so plain division rounds down
+    return {pos.x / island_size, pos.y / island_size};
+}
+
+auto build_island_collider(
+    std::span<const std::pair<chunk_pos, chunk_static_pixels>> chunks,
+    island_pos pos,
+    collider_chains& out
+) -> void
 {
-    assert(pixels.any());
-    for (int x = 0; x != sand::config::chunk_size; ++x) {
-        for (int y = 0; y != sand::config::chunk_size; ++y) {
-            const auto index = y * sand::config::chunk_size + x;
-            if (pixels.test(index)) {
-                return {x, y};
+    thread_collider_builder().build_island(chunks, pos, out);
+}
+
+auto collider_at(level& l, chunk_pos pos) -> chunk_collider&
+{
+    return l.physics.chunk_colliders[pos.y * l.pixels.width_in_chunks() + pos.x];
+}
+
+auto width_in_islands(const level& l) -> i32
+{
+    return (l.pixels.width_in_chunks() + island_size - 1) / island_size;
+}
+
+auto island_at(level& l, island_pos pos) -> island_collider&
+{
+    return l.physics.island_colliders[pos.y * width_in_islands(l) + pos.x];
+}
+
+// Replaces the chains of a static body, only creating the body if there isn't one yet,
+// so that Box2D isn't asked to tear down and rebuild the body on every rebuild
+auto set_static_chains(level& l, b2BodyId& body, std::vector<b2ChainId>& chain_ids, const collider_chains& chains) -> void
+{
+    for (const auto id : chain_ids) {
+        b2DestroyChain(id);
+    }
+    chain_ids.clear();
+
+    if (!b2Body_IsValid(body)) {
+        b2BodyDef body_def = b2DefaultBodyDef();
+        body_def.type = b2_staticBody;
+        body_def.position = {0.0f, 0.0f};
+        body = b2CreateBody(l.physics.world, &body_def);
+        b2Body_SetUserData(body, to_user_data(apx::null));
+    }
+
+    for (std::size_t i = 0; i != chains.size(); ++i) {
+        const auto points = chains.loop(i);
+        b2ChainDef def = b2DefaultChainDef();
+        def.enableSensorEvents = true;
+        def.count = points.size();
+        def.points = points.data();
+        def.isLoop = true;
+        chain_ids.push_back(b2CreateChain(body, &def));
+    }
+}
+
+auto clear_static_chains(std::vector<b2ChainId>& chain_ids) -> void
+{
+    for (const auto id : chain_ids) {
+        b2DestroyChain(id);
+    }
+    chain_ids.clear();
+}
+
+// Finished jobs are kept for reuse, along with the chains they have grown
+template <typename Job>
+auto take_job(std::vector<std::unique_ptr<Job>>& free_jobs) -> std::unique_ptr<Job>
+{
+    if (free_jobs.empty()) {
+        return std::make_unique<Job>();
+    }
+    auto job = std::move(free_jobs.back());
+    free_jobs.pop_back();
+    return job;
+}
+
+auto finish_job(auto& job) -> void
+{
+    job.done = true;
+    job.done.notify_one();
+}
+
+auto queue_chunk_collider(level& l, chunk_pos pos, bool force) -> bool
+{
+    const auto top_left = get_chunk_top_left(pos);
+    const auto mask = get_static_pixels(l.pixels, pos);
+
+    auto& collider = collider_at(l, pos);
+    if (collider.active && !force && collider.mask == mask) {
+        return false;
+    }
+    collider.active = true;
+    collider.mask = mask;
+
+    auto& job = *l.physics.collider_jobs.emplace_back(take_job(l.physics.free_collider_jobs));
+    job.pos = pos;
+    job.mask = mask;
+    job.top_left = top_left;
+    job.done = false;
+    global_thread_pool().post([&job] {
+        build_chunk_collider(job.mask, job.top_left, job.chains);
+        finish_job(job);
+    });
+    return true;
+}
+
+auto invalidate_chunk_collider(level& l, chunk_pos pos) -> void
+{
+    // Before the first update there are no colliders to invalidate
+    if (l.physics.chunk_colliders.empty()) return;
+
+    // Inactive chunks are traced whether or not they are awake, and leave their island
+    collider_at(l, pos).active = false;
+}
+
+auto apply_chunk_colliders(level& l) -> void
+{
+    for (auto& job : l.physics.collider_jobs) {
+        job->done.wait(false);
+        auto& collider = collider_at(l, job->pos);
+        set_static_chains(l, collider.body, collider.chains, job->chains);
+        l.physics.free_collider_jobs.push_back(std::move(job));
+    }
+    l.physics.collider_jobs.clear();
+
+    for (auto& job : l.physics.island_jobs) {
+        job->done.wait(false);
+        auto& island = island_at(l, job->pos);
+        if (job->chunks.empty()) {
+            clear_static_chains(island.chains);
+        } else {
+            set_static_chains(l, island.body, island.chains, job->chains);
+        }
+
+        // The island now covers these chunks so their own chains can go, but their
+        // bodies are kept for when they wake
+        for (const auto& [chunk, mask] : job->chunks) {
+            clear_static_chains(collider_at(l, chunk).chains);
+        }
+        l.physics.free_island_jobs.push_back(std::move(job));
+    }
+    l.physics.island_jobs.clear();
+}
+
+auto queue_island_collider(level& l, island_pos pos) -> void
+{
+    auto& job = *l.physics.island_jobs.emplace_back(take_job(l.physics.free_island_jobs));
+    job.pos = pos;
+    job.chunks.clear();
+    job.done = false;
+
+    const auto max_x = std::min((pos.x + 1) * island_size, l.pixels.width_in_chunks());
+    const auto max_y = std::min((pos.y + 1) * island_size, l.pixels.height_in_chunks());
+    for (i32 y = pos.y * island_size; y != max_y; ++y) {
+        for (i32 x = pos.x * island_size; x != max_x; ++x) {
+            const auto& collider = collider_at(l, {x, y});
+            if (collider.merged) {
+                job.chunks.emplace_back(chunk_pos{x, y}, collider.mask);
             }
         }
     }
-    std::unreachable();
+
+    global_thread_pool().post([&job] {
+        if (!job.chunks.empty()) {
+            build_island_collider(job.chunks, job.pos, job.chains);
+        }
+        finish_job(job);
+    });
 }
 
-auto create_chunk_rigid_bodies(level& l, pixel_pos top_left) -> b2BodyId
+// Flags the chunks within collider_margin of an entity's body, indexed by
+// y * width_in_chunks + x
+auto find_chunks_near_bodies(level& l) -> void
 {
-    b2BodyDef body_def = b2DefaultBodyDef();
-    body_def.type = b2_staticBody;
-    body_def.position = {0.0f, 0.0f};
-    auto body = b2CreateBody(l.physics.world, &body_def);
-    b2Body_SetUserData(body, to_user_data(apx::null));
-    
-    auto chunk_pixels = chunk_static_pixels{};
-    
-    // Fill up the bitset
-    for (int x = 0; x != sand::config::chunk_size; ++x) {
-        for (int y = 0; y != sand::config::chunk_size; ++y) {
-            const auto index = y * sand::config::chunk_size + x;
-            if (is_static_pixel(top_left, l.pixels, top_left + glm::ivec2{x, y})) {
-                chunk_pixels.set(index);
+    const auto width = l.pixels.width_in_chunks();
+    const auto height = l.pixels.height_in_chunks();
+    auto& near = l.physics.chunks_near_bodies;
+    near.assign(width * height, false);
+
+    for (auto e : l.entities.view<body_component>()) {
+        const auto& comp = l.entities.get<body_component>(e);
+        if (!b2Body_IsValid(comp.body)) continue;
+
+        const auto aabb = b2Body_ComputeAABB(comp.body);
+        const auto lower = glm::ivec2{physics_to_pixel(aabb.lowerBound)} - collider_margin;
+        const auto upper = glm::ivec2{physics_to_pixel(aabb.upperBound)} + collider_margin;
+        const auto min_chunk = glm::max(lower / config::chunk_size, glm::ivec2{0, 0});
+        const auto max_chunk = glm::min(upper / config::chunk_size, glm::ivec2{width - 1, height - 1});
+        for (i32 y = min_chunk.y; y <= max_chunk.y; ++y) {
+            for (i32 x = min_chunk.x; x <= max_chunk.x; ++x) {
+                near[y * width + x] = true;
             }
         }
     }
+}
 
-    b2ShapeDef def = b2DefaultShapeDef();
-    def.material.friction = 1;
-    
-    // While bitset still has elements, take one, apply algorithm to create
-    // triangles, then flood remove the pixels
-    while (chunk_pixels.any()) {
-        const auto offset = get_start_pixel_offset(chunk_pixels);
-        const auto boundary = calc_boundary(top_left, l.pixels, top_left + offset, 1.5f);
-
-        if (boundary.size() > 3) { // If there's only a small group, dont bother
-            std::vector<b2Vec2> points;
-            points.reserve(boundary.size());
-            for (const auto pos : boundary) {
-                points.push_back(pixel_to_physics(pos));
+auto update_chunk_colliders(level& l) -> void
+{
+    // Swap in the colliders traced since the last update before queueing new ones
+    apply_chunk_colliders(l);
+    l.physics.colliders_rebuilt = 0;
+    l.physics.colliders_skipped = 0;
+    l.physics.islands_rebuilt = 0;
+    l.physics.colliders_dropped = 0;
+
+    // The grids are sized here as the physics world doesn't know the size of the level
+    const auto num_chunks = static_cast<std::size_t>(l.pixels.width_in_chunks() * l.pixels.height_in_chunks());
+    if (l.physics.chunk_colliders.size() != num_chunks) {
+        l.physics.chunk_colliders.resize(num_chunks);
+        const auto height_in_islands = (l.pixels.height_in_chunks() + island_size - 1) / island_size;
+        l.physics.island_colliders.resize(width_in_islands(l) * height_in_islands);
+    }
+
+    const auto only_near = l.physics.only_colliders_near_bodies;
+    if (only_near) {
+        find_chunks_near_bodies(l);
+    }
+    const auto& near = l.physics.chunks_near_bodies;
+
+    auto& changed_islands = l.physics.changed_islands;
+    changed_islands.clear();
+    for (i32 x = 0; x != l.pixels.width_in_chunks(); ++x) {
+        for (i32 y = 0; y != l.pixels.height_in_chunks(); ++y) {
+            const auto pos = chunk_pos{x, y};
+            auto& collider = collider_at(l, pos);
+
+            if (only_near && !near[y * l.pixels.width_in_chunks() + x]) {
+                // Forgetting the chunk means it gets traced from scratch when needed again.
+                // Invalidated chunks are inactive but can still have a body or an island.
+                if (collider.active || b2Body_IsValid(collider.body) || collider.merged) {
+                    if (collider.merged) {
+                        changed_islands.push_back(get_island(pos));
+                    }
+                    if (b2Body_IsValid(collider.body)) {
+                        b2DestroyBody(collider.body);
+                    }
+                    collider.body = b2_nullBodyId;
+                    collider.chains.clear();
+                    collider.active = false;
+                    collider.sleeping_updates = 0;
+                    collider.merged = false;
+                    ++l.physics.colliders_dropped;
+                }
+            }
+            else if (l.pixels[pos].should_step || !collider.active) {
+                // Chunks without colliders get them even when asleep, and a chunk that
+                // wakes leaves its island and goes back to its own body
+                auto force = false;
+                collider.sleeping_updates = 0;
+                if (collider.merged) {
+                    collider.merged = false;
+                    changed_islands.push_back(get_island(pos));
+                    force = true;
+                }
+
+                if (queue_chunk_collider(l, pos, force)) {
+                    ++l.physics.colliders_rebuilt;
+                } else {
+                    ++l.physics.colliders_skipped;
+                }
+            }
+            else if (l.physics.merge_sleeping_colliders) {
+                if (!collider.merged && ++collider.sleeping_updates >= island_merge_delay) {
+                    collider.merged = true;
+                    changed_islands.push_back(get_island(pos));
+                }
+            }
+            else if (collider.merged) { // Merging was turned off
+                collider.merged = false;
+                collider.sleeping_updates = 0;
+                changed_islands.push_back(get_island(pos));
+                queue_chunk_collider(l, pos, true);
+                ++l.physics.colliders_rebuilt;
             }
-            b2ChainDef def = b2DefaultChainDef();
-            def.enableSensorEvents = true;
-            def.count = points.size();
-            def.points = points.data();
-            def.isLoop = true;
-            b2CreateChain(body, &def);
         }
-        flood_remove(chunk_pixels, offset);
     }
 
-    return body;
+    std::ranges::sort(changed_islands);
+    const auto [first, last] = std::ranges::unique(changed_islands);
+    changed_islands.erase(first, last);
+    for (const auto island : changed_islands) {
+        queue_island_collider(l, island);
+        ++l.physics.islands_rebuilt;
+    }
 }
-    
 
-}
\ No newline at end of file
+}
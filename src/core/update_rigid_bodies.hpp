@@ -3,11 +3,123 @@
 
 #include "common.hpp"
 
-struct b2BodyId;
+#include <array>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include <box2d/box2d.h>
 
 namespace sand {
 
-class level;
-auto create_chunk_rigid_bodies(level& l, pixel_pos top_left) -> b2BodyId;
+static_assert(config::chunk_size == 64, "each row of a chunk's static pixels is a u64");
+
+// The solid, non-falling pixels of a chunk, with a word per row and a bit per pixel
+struct chunk_static_pixels
+{
+    std::array<u64, config::chunk_size> rows = {};
+
+    auto test(i32 x, i32 y) const -> bool { return (rows[y] >> x) & 1; }
+    auto operator==(const chunk_static_pixels&) const -> bool = default;
+};
+
+// The chain loops making up a static body, in physics space. The loops are stored end
+// to end so that a set of chains can be refilled without allocating.
+struct collider_chains
+{
+    std::vector<b2Vec2>      points;
+    std::vector<std::size_t> loop_ends; // One past the last point of each loop
+
+    auto clear() -> void
+    {
+        points.clear();
+        loop_ends.clear();
+    }
+
+    auto size() const -> std::size_t { return loop_ends.size(); }
+
+    auto loop(std::size_t i) const -> std::span<const b2Vec2>
+    {
+        const auto begin = i == 0 ? 0 : loop_ends[i - 1];
+        return std::span{points}.subspan(begin, loop_ends[i] - begin);
+    }
+};
+
+// Sleeping chunks can have their colliders merged into one body per island, a square
+// block of chunks, which removes the seams at chunk borders that the player's foot
+// sensor would otherwise catch on. Islands are fixed so that when a chunk wakes only
+// its own island needs tracing again. The price is that seams remain at island borders,
+// one every island_size chunks, even when the islands either side are both asleep.
+static constexpr i32 island_size = 4; // In chunks
+static constexpr i32 island_merge_delay = 60; // Updates a chunk must sleep for to merge
+
+// How far round each dynamic body, in pixels, chunks are given colliders when only
+// building colliders near bodies. Bodies move less than a chunk per update, and their
+// colliders are an update behind, so this leaves room for both.
+static constexpr i32 collider_margin = config::chunk_size;
+
+// The position of an island, in units of islands
+using island_pos = chunk_pos;
+
+auto get_island(chunk_pos pos) -> island_pos;
+
+struct level;
+class pixel_world;
+
+// Builds the mask a row at a time straight from the chunk's type and flag planes
+auto get_static_pixels(const pixel_world& w, chunk_pos pos) -> chunk_static_pixels;
+
+// The original pixel by pixel version, kept as a reference for sandfall_bench
+auto get_static_pixels_per_pixel(const pixel_world& w, chunk_pos pos) -> chunk_static_pixels;
+
+// Traces static pixels into chain loops. The builder keeps its scratch space between
+// builds, so once it has grown to fit the largest area it has seen, building a collider
+// doesn't allocate. It only touches its arguments, so each thread can have its own.
+class collider_builder
+{
+    std::vector<u8>        d_cases;
+    std::vector<u8>        d_visited;
+    std::vector<pixel_pos> d_boundary;
+    std::vector<pixel_pos> d_simplified;
+
+    template <typename IsStatic>
+    auto trace(i32 width, i32 height, IsStatic&& is_static, pixel_pos top_left, collider_chains& out) -> void;
+
+public:
+    auto build_chunk(const chunk_static_pixels& pixels, pixel_pos top_left, collider_chains& out) -> void;
+
+    // As above, for the given chunks of an island traced as one
+    auto build_island(
+        std::span<const std::pair<chunk_pos, chunk_static_pixels>> chunks,
+        island_pos pos,
+        collider_chains& out
+    ) -> void;
+};
+
+// Build with the calling thread's own builder
+auto build_chunk_collider(const chunk_static_pixels& pixels, pixel_pos top_left, collider_chains& out) -> void;
+auto build_island_collider(
+    std::span<const std::pair<chunk_pos, chunk_static_pixels>> chunks,
+    island_pos pos,
+    collider_chains& out
+) -> void;
+
+// Colliders are rebuilt in two halves so that tracing happens off the main thread.
+// queue_chunk_collider snapshots a chunk's static pixels and, if they have changed,
+// hands them to the thread pool, returning true. apply_chunk_colliders waits for the
+// jobs queued on the previous update and swaps their bodies in, so colliders are never
+// more than one update behind the pixels.
+auto queue_chunk_collider(level& l, chunk_pos pos, bool force = false) -> bool;
+auto queue_island_collider(level& l, island_pos pos) -> void;
+auto apply_chunk_colliders(level& l) -> void;
+
+// Makes the next update_chunk_colliders trace the chunk again even if it is asleep or
+// merged into its island, for pixels that were removed outside of stepping
+auto invalidate_chunk_collider(level& l, chunk_pos pos) -> void;
+
+// Applies the finished jobs then queues new ones for every awake chunk whose static
+// pixels changed, merging and unmerging chunks with their islands as they fall asleep
+// and wake up, and dropping the colliders of chunks far from every dynamic body.
+auto update_chunk_colliders(level& l) -> void;
 
-}
\ No newline at end of file
+}
@@ -1,14 +1,13 @@
 #include "utility.hpp"
 #include "camera.hpp"
 #include "input.hpp"
-#include "window.hpp"
 
 #include <array>
-#include <random>
-#include <numbers>
 #include <iostream>
 
+#ifdef _WIN32
 #include <Windows.h>
+#endif
 
 namespace sand {
 
@@ -41,46 +40,6 @@ auto timer::now() const -> clock::time_point
     return d_clock.now();
 }
 
-auto random_from_range(float min, float max) -> float
-{
-    static std::default_random_engine gen;
-    return std::uniform_real_distribution(min, max)(gen);
-}
-
-auto random_from_range(int min, int max) -> int
-{
-    static std::default_random_engine gen;
-    return std::uniform_int_distribution(min, max)(gen);
-}
-
-auto random_normal(float centre, float sd) -> float
-{
-    static std::default_random_engine gen;
-    return std::normal_distribution(centre, sd)(gen);
-}
-
-auto random_from_circle(float radius) -> glm::ivec2
-{
-    const auto r = random_from_range(0.0f, radius);
-    const auto x = random_from_range(0.0f, 2.0f * std::numbers::pi);
-    return { r * std::cos(x), r * std::sin(x) };
-}
-
-auto coin_flip() -> bool
-{
-    return random_from_range(0, 1) == 0;
-}
-
-auto sign_flip() -> int
-{
-    return coin_flip() ? 1 : -1;
-}
-
-auto random_unit() -> float
-{
-    return random_from_range(0.0f, 1.0f);
-}
-
 auto _print_inner(const std::string& msg) -> void
 {
     std::cout << msg;
@@ -88,6 +47,7 @@ auto _print_inner(const std::string& msg) -> void
 
 auto get_executable_filepath() -> std::filesystem::path
 {
+#ifdef _WIN32
     auto buffer = std::vector<char>{};
     buffer.resize(16);
     while (true) {
@@ -97,6 +57,9 @@ auto get_executable_filepath() -> std::filesystem::path
         }
         buffer.resize(2 * buffer.size());
     }
+#else
+    return std::filesystem::read_symlink("/proc/self/exe");
+#endif
 }
 
 auto mouse_pos_world_space(const input& in, const sand::camera& c) -> glm::vec2
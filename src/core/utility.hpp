@@ -6,11 +6,13 @@
 #include <span>
 #include <format>
 #include <filesystem>
+#include <vector>
 
 #include <glm/glm.hpp>
 #include <box2d/box2d.h>
 
 #include "common.hpp"
+#include "random.hpp"
 
 namespace sand {
 
@@ -48,22 +50,6 @@ public:
     auto now() const -> clock::time_point;
 };
 
-auto random_from_range(float min, float max) -> float;
-auto random_from_range(int min, int max) -> int;
-auto random_from_circle(float radius) -> glm::ivec2;
-
-auto random_normal(float centre, float sd) -> float;
-
-template <typename Elements>
-auto random_element(const Elements& elements)
-{
-    return elements[random_from_range(0, std::ssize(elements) - 1)];
-}
-
-auto coin_flip() -> bool;
-auto sign_flip() -> int;
-auto random_unit() -> float; // Same as random_from_range(0.0f, 1.0f)
-
 constexpr auto from_hex(int hex) -> glm::vec4
 {
     const auto blue = static_cast<float>(hex & 0xff) / 256.0f;
@@ -118,28 +104,12 @@ concept has_to_string_member = requires(T obj)
     { obj.to_string() } -> std::convertible_to<std::string>;
 };
 
-template <has_to_string_member T>
-struct std::formatter<T> : std::formatter<std::string>
-{
-    auto format(const T& obj, auto& ctx) const {
-        return std::formatter<std::string>::format(obj.to_string(), ctx);
-    }
-};
-
 template <typename T>
 concept has_to_string_free_function = requires(T obj)
 {
     { sand::to_string(obj) } -> std::convertible_to<std::string>;
 };
 
-template <has_to_string_free_function T>
-struct std::formatter<T> : std::formatter<std::string>
-{
-    auto format(const T& obj, auto& ctx) const {
-        return std::formatter<std::string>::format(sand::to_string(obj), ctx);
-    }
-};
-
 template <typename T>
 const T& signed_index(const std::vector<T>& v, int index)
 {
@@ -148,4 +118,22 @@ const T& signed_index(const std::vector<T>& v, int index)
     return v[index];
 }
 
-}
\ No newline at end of file
+}
+
+// Specialisations of std templates have to be declared outside of namespace sand
+
+template <sand::has_to_string_member T>
+struct std::formatter<T> : std::formatter<std::string>
+{
+    auto format(const T& obj, auto& ctx) const {
+        return std::formatter<std::string>::format(obj.to_string(), ctx);
+    }
+};
+
+template <sand::has_to_string_free_function T>
+struct std::formatter<T> : std::formatter<std::string>
+{
+    auto format(const T& obj, auto& ctx) const {
+        return std::formatter<std::string>::format(sand::to_string(obj), ctx);
+    }
+};
@@ -3,11 +3,19 @@
 #include "utility.hpp"
 
 #include "update_rigid_bodies.hpp"
+#include "pixel_cluster.hpp"
 #include "explosion.hpp"
+#include "thread_pool.hpp"
 
 #include <cassert>
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <memory>
 #include <ranges>
+#include <tuple>
+#include <utility>
 
 namespace sand {
 namespace {
@@ -30,15 +38,34 @@ static constexpr auto adjacent_offsets = std::array{
     glm::ivec2{0, -1}
 };
 
+// Waking a pixel marks the pixels this close to it as needing an update. Two is
+// needed for relays, which let power jump over them.
+static constexpr auto wake_margin = 2;
+
+// Chunks with the same parity are never adjacent, so each of these phases can be
+// stepped in parallel.
+static constexpr auto checkerboard_phases = std::array{
+    glm::ivec2{0, 1},
+    glm::ivec2{1, 1},
+    glm::ivec2{0, 0},
+    glm::ivec2{1, 0}
+};
+
+// Random streams for the parts of a step that aren't tied to a chunk. Chunks use their
+// index as their stream, so these count down from the top to stay clear of them.
+static constexpr auto serial_stream    = std::numeric_limits<u64>::max();
+static constexpr auto explosion_stream = serial_stream - 1;
+static constexpr auto after_step_stream = serial_stream - 2;
+
 auto can_pixel_move_to(const pixel_world& w, pixel_pos src_pos, pixel_pos dst_pos) -> bool
 {
     if (!w.is_valid_pixel(src_pos) || !w.is_valid_pixel(dst_pos)) { return false; }
 
     // If the destination is empty, we can always move there
-    if (w[dst_pos].type == pixel_type::none) { return true; }
+    if (w.type(dst_pos) == pixel_type::none) { return true; }
 
-    const auto src = properties(w[src_pos]).phase;
-    const auto dst = properties(w[dst_pos]).phase;
+    const auto src = properties(w.type(src_pos)).phase;
+    const auto dst = properties(w.type(dst_pos)).phase;
 
     using pm = pixel_phase;
     switch (src) {
@@ -61,10 +88,9 @@ auto set_adjacent_free_falling(pixel_world& w, pixel_pos pos) -> void
 
     for (const auto x : {l, r}) {
         if (w.is_valid_pixel(x)) {
-            const auto& px = w[x];
-            const auto& props = properties(px);
+            const auto& props = properties(w.type(x));
             if (props.gravity_factor != 0.0f) {
-                w.visit(x, [&](pixel& p) { p.flags[is_falling] = true; });
+                w.visit(x, [&](pixel& p) { p.flags.set(is_falling); });
             }
         }
     }
@@ -77,7 +103,7 @@ auto move_offset(pixel_world& w, pixel_pos& pos, glm::ivec2 offset) -> bool
     const auto start_pos = pos;
 
     const auto a = pos;
-    const auto b = pos + offset;
+    const auto b = pos + glm::clamp(offset, glm::ivec2{-config::max_pixel_travel}, glm::ivec2{config::max_pixel_travel});
     const auto steps = glm::max(glm::abs(a.x - b.x), glm::abs(a.y - b.y));
 
     for (int i = 0; i != steps; ++i) {
@@ -93,7 +119,7 @@ auto move_offset(pixel_world& w, pixel_pos& pos, glm::ivec2 offset) -> bool
     }
 
     if (start_pos != pos) {
-        w.visit(pos, [&](pixel& p) { p.flags[is_falling] = true; });
+        w.visit(pos, [&](pixel& p) { p.flags.set(is_falling); });
         return true;
     }
 
@@ -105,7 +131,7 @@ auto is_surrounded(const pixel_world& w, pixel_pos pos) -> bool
     for (const auto& offset : neighbour_offsets) {
         const auto n = pos + offset;
         if (w.is_valid_pixel(n)) {
-            if (w[n].type == pixel_type::none) {
+            if (w.type(n) == pixel_type::none) {
                 return false;
             }
         }
@@ -122,18 +148,20 @@ auto sign(float f) -> int
 
 inline auto update_pixel_position(pixel_world& w, pixel_pos& pos) -> void
 {
-    const auto& props = properties(w[pos]);
+    const auto& props = properties(w.type(pos));
 
     // Apply gravity
     if (props.gravity_factor) {
-        const auto velocity = w[pos].velocity;
+        const auto velocity = unpack_velocity(w.velocity(pos));
         const auto gravity_factor = props.gravity_factor;
-        w.visit_no_wake(pos, [&](pixel& p) { p.velocity += gravity_factor * config::gravity * config::time_step; });
+        w.visit_no_wake(pos, [&](pixel& p) {
+            p.velocity = pack_velocity(velocity + gravity_factor * config::gravity * config::time_step);
+        });
         if (move_offset(w, pos, velocity)) return;
     }
 
     // If we have resistance to moving and we are not, then we are not moving
-    if (props.inertial_resistance && !w[pos].flags[is_falling]) {
+    if (props.inertial_resistance && !w.flags(pos)[is_falling]) {
         return;
     }
 
@@ -160,59 +188,22 @@ inline auto update_pixel_position(pixel_world& w, pixel_pos& pos) -> void
     }
 }
 
-// Determines if the pixel at the given offset should power the current position.
-// offset must be a unit vector.
-auto should_get_powered(const pixel_world& w, pixel_pos pos, glm::ivec2 offset) -> bool
-{
-    const auto& dst = w[pos];
-    const auto& src = w[pos + offset];
-
-    // Prevents current from flowing from diode_out to diode_in
-    if (dst.type == pixel_type::diode_in && src.type == pixel_type::diode_out) {
-        return false;
-    }
-
-    // diode_out can *only* be powered by diode_in and itself
-    if (dst.type == pixel_type::diode_out && src.type != pixel_type::diode_in
-                                          && src.type != pixel_type::diode_out) {
-        return false;
-    }
-
-    // If the neighbour is a relay, we need to jump over it and check the pixel on the
-    // other side.
-    if (src.type == pixel_type::relay) {
-        auto new_pos = pos + 2 * offset;
-        if (!w.is_valid_pixel({new_pos.x, new_pos.y})) return false;
-        const auto& new_src = w[new_pos];
-        const auto& props = properties(new_src);
-        return is_active_power_source(new_src)
-            || ((props.power_max) / 2 < new_src.power && new_src.power < props.power_max);
-    }
-
-    // dst can get powered if src is either a power source or powered. Excludes the
-    // maximum power level so electricity can only flow one block per tick.
-    const auto& props = properties(src);
-    return is_active_power_source(src)
-        || ((props.power_max) / 2 < src.power && src.power < props.power_max);
-}
-
 // Update logic for single pixels depending on properties only
 inline auto update_pixel_attributes(pixel_world& w, pixel_pos pos) -> void
 {
-    const auto& px = w[pos];
-    const auto& props = properties(px);
+    const auto& props = properties(w.type(pos));
 
     if (props.always_awake) {
-        w.wake_chunk_with_pixel(pos);
+        w.keep_active(pos);
     }
 
     // is_burning status
-    if (px.flags[is_burning]) {
+    if (w.flags(pos)[is_burning]) {
 
         // See if it can be put out
         const auto put_out = is_surrounded(w, pos) ? props.put_out_surrounded : props.put_out;
         if (random_unit() < put_out) {
-            w.visit(pos, [&](pixel& p) { p.flags[is_burning] = false; });
+            w.visit(pos, [&](pixel& p) { p.flags.set(is_burning, false); });
         }
 
         // See if it gets destroyed
@@ -222,7 +213,7 @@ inline auto update_pixel_attributes(pixel_world& w, pixel_pos pos) -> void
 
         // See if it explodes
         if (random_unit() < props.explosion_chance) {
-            apply_explosion(w, pos, sand::explosion{
+            w.explode(pos, sand::explosion{
                 .min_radius = 5.0f, .max_radius = 10.0f, .scorch = 5.0f
             });
         }
@@ -231,40 +222,20 @@ inline auto update_pixel_attributes(pixel_world& w, pixel_pos pos) -> void
 
     // Electricity
     switch (props.power_type) {
-        case pixel_power_type::conductor: {
-            if (px.power > 0) {
-                w.visit(pos, [&](pixel& p) { --p.power; });
-            }
-
-            // Check to see if we should power up just before we hit zero in order to
-            // maintain a current
-            if (px.power <= 1) {
-                for (const auto& offset : adjacent_offsets) {
-                    if (w.is_valid_pixel(pos + offset) && should_get_powered(w, pos, offset)) {
-                        w.visit(pos, [&](pixel& p) { p.power = props.power_max; });
-                        break;
-                    }
-                }
-            }
-
-            if (px.power > 0 && props.explodes_on_power) {
-                apply_explosion(w, pos, sand::explosion{
-                    .min_radius = 25.0f, .max_radius = 30.0f, .scorch = 10.0f
-                });
-            }
-        } break;
+        // Conductors are powered by the circuit, see circuit.hpp
+        case pixel_power_type::conductor: {} break;
 
         case pixel_power_type::source: {
-            if (px.power < props.power_max) {
-                w.visit(pos, [&](pixel& p) { ++p.power; });
+            if (w.power(pos) < props.power_max) {
+                w.visit_no_wake(pos, [&](pixel& p) { ++p.power; });
             }
             for (const auto& offset : adjacent_offsets) {
                 if (!w.is_valid_pixel(pos + offset)) continue;
-                auto& neighbour = w[pos + offset];
+                const auto neighbour = pos + offset;
 
                 // Powered diode_offs disable power sources
-                if (neighbour.type == pixel_type::diode_out && neighbour.power > 0) {
-                    w.visit(pos, [&](pixel& p) { p.power = 0; });
+                if (w.type(neighbour) == pixel_type::diode_out && w.power(neighbour) > 0) {
+                    w.visit_no_wake(pos, [&](pixel& p) { p.power = 0; });
                     break;
                 }
             }
@@ -273,10 +244,6 @@ inline auto update_pixel_attributes(pixel_world& w, pixel_pos pos) -> void
         case pixel_power_type::none: {} break;
     }
 
-    if (px.power > 0) {
-        w.wake_chunk_with_pixel(pos);
-    }
-
     if (random_unit() < props.spontaneous_destroy) {
         w.set(pos, pixel::air());
     }
@@ -284,26 +251,23 @@ inline auto update_pixel_attributes(pixel_world& w, pixel_pos pos) -> void
 
 inline auto update_pixel_neighbours(pixel_world& w, pixel_pos pos) -> void
 {
-    auto& px = w[pos];
-    const auto& props = properties(px);
+    const auto& props = properties(w.type(pos));
 
     // Affect adjacent neighbours as well as diagonals
     for (const auto& offset : neighbour_offsets) {
         const auto neigh_pos = pos + offset;
         if (!w.is_valid_pixel(neigh_pos)) continue;   
 
-        const auto& neighbour = w[neigh_pos];
-
         // Boil water
         if (props.can_boil_water) {
-            if (neighbour.type == pixel_type::water) {
+            if (w.type(neigh_pos) == pixel_type::water) {
                 w.set(neigh_pos, pixel::steam());
             }
         }
 
         // Corrode neighbours
         if (props.is_corrosion_source) {
-            if (random_unit() > properties(neighbour).corrosion_resist) {
+            if (random_unit() > properties(w.type(neigh_pos)).corrosion_resist) {
                 w.set(neigh_pos, pixel::air());
                 if (random_unit() > 0.9f) {
                     w.set(pos, pixel::air());
@@ -312,15 +276,15 @@ inline auto update_pixel_neighbours(pixel_world& w, pixel_pos pos) -> void
         }
         
         // Spread fire
-        if (props.is_burn_source || px.flags[is_burning]) {
-            if (random_unit() < properties(neighbour).flammability) {
-                w.visit(neigh_pos, [&](pixel& p) { p.flags[is_burning] = true; });
+        if (props.is_burn_source || w.flags(pos)[is_burning]) {
+            if (random_unit() < properties(w.type(neigh_pos)).flammability) {
+                w.visit(neigh_pos, [&](pixel& p) { p.flags.set(is_burning); });
             }
         }
 
         // Produce embers
-        const bool can_produce_embers = props.is_ember_source || px.flags[is_burning];
-        if (can_produce_embers && neighbour.type == pixel_type::none) {
+        const bool can_produce_embers = props.is_ember_source || w.flags(pos)[is_burning];
+        if (can_produce_embers && w.type(neigh_pos) == pixel_type::none) {
             if (random_unit() < 0.01f) {
                 w.set(neigh_pos, pixel::ember());
             }
@@ -330,25 +294,44 @@ inline auto update_pixel_neighbours(pixel_world& w, pixel_pos pos) -> void
 
 auto update_pixel(pixel_world& w, pixel_pos pos) -> pixel_pos
 {
-    if (w[pos].type == pixel_type::none || w[pos].flags[is_updated]) {
+    if (w.type(pos) == pixel_type::none || w.updated_tick(pos) == w.tick()) {
         return pos;
     }
 
-    const auto start_pos = pos;
-    update_pixel_position(w, pos);
+    // Inert pixels, such as rock, have nothing to do
+    const auto mask = behaviour(w.type(pos));
+    if (!mask) {
+        return pos;
+    }
 
-    // Pixels that don't move have their is_falling flag set to false
-    if (pos == start_pos) {
-        w.visit_no_wake(pos, [&](pixel& p) {
-            p.flags[is_falling] = false;
-            if (properties(p).gravity_factor) {
-                p.velocity = glm::ivec2{0, 1};
-            }
-        });
+    if (has_behaviour(mask, pixel_behaviour::moves)) {
+        const auto start_pos = pos;
+        update_pixel_position(w, pos);
+
+        // Pixels that don't move have their is_falling flag set to false
+        if (pos == start_pos) {
+            w.visit_no_wake(pos, [&](pixel& p) {
+                p.flags.set(is_falling, false);
+                if (properties(p).gravity_factor) {
+                    p.velocity = pack_velocity({0, 1});
+                }
+            });
+        }
     }
 
-    update_pixel_neighbours(w, pos);
-    update_pixel_attributes(w, pos);
+    const auto burning = has_behaviour(mask, pixel_behaviour::burns) && w.flags(pos)[is_burning];
+    if (burning || has_behaviour(mask, pixel_behaviour::reacts)) {
+        update_pixel_neighbours(w, pos);
+    }
+
+    // The neighbour update can change this pixel, so check again
+    const auto new_mask = behaviour(w.type(pos));
+    const auto new_burning = has_behaviour(new_mask, pixel_behaviour::burns) && w.flags(pos)[is_burning];
+    if (new_burning || has_behaviour(new_mask, pixel_behaviour::powers)
+                    || has_behaviour(new_mask, pixel_behaviour::decays)
+                    || has_behaviour(new_mask, pixel_behaviour::wakes)) {
+        update_pixel_attributes(w, pos);
+    }
     return pos;
 }
 
@@ -357,6 +340,22 @@ auto get_chunk_from_pixel(pixel_pos pos) -> chunk_pos
     return {pos.x / config::chunk_size, pos.y / config::chunk_size};
 }
 
+// Neighbouring chunks can be woken from two workers at once, so the dirty rects are
+// only ever grown atomically
+auto atomic_min(i32& value, i32 desired) -> void
+{
+    auto ref = std::atomic_ref{value};
+    auto curr = ref.load(std::memory_order_relaxed);
+    while (desired < curr && !ref.compare_exchange_weak(curr, desired, std::memory_order_relaxed)) {}
+}
+
+auto atomic_max(i32& value, i32 desired) -> void
+{
+    auto ref = std::atomic_ref{value};
+    auto curr = ref.load(std::memory_order_relaxed);
+    while (desired > curr && !ref.compare_exchange_weak(curr, desired, std::memory_order_relaxed)) {}
+}
+
 auto player_handle_event(level& l, const context& ctx, entity e, const event& ev) -> void
 {
     auto [body_comp, player_comp] = l.entities.get_all<body_component, player_component>(e);
@@ -482,16 +481,83 @@ auto get_chunk_top_left(chunk_pos pos) -> pixel_pos
     return {pos.x * config::chunk_size, pos.y * config::chunk_size};
 }
 
-auto pixel_world::wake_chunk(chunk_pos pos) -> void
+auto pixel_world::wake_chunk(chunk_pos pos, glm::ivec2 min, glm::ivec2 max) -> void
 {
     assert(is_valid_chunk(pos));
-    at(pos).should_step_next = true;
+    auto& chunk = at(pos);
+    std::atomic_ref{chunk.should_step_next}.store(true, std::memory_order_relaxed);
+    atomic_min(chunk.dirty_next.min.x, std::max(min.x, 0));
+    atomic_min(chunk.dirty_next.min.y, std::max(min.y, 0));
+    atomic_max(chunk.dirty_next.max.x, std::min(max.x, config::chunk_size - 1));
+    atomic_max(chunk.dirty_next.max.y, std::min(max.y, config::chunk_size - 1));
+}
+
+pixel_world::pixel_world(i32 width, i32 height, const std::vector<pixel>& pixels)
+    : d_types(pixels.size())
+    , d_flags(pixels.size())
+    , d_power(pixels.size())
+    , d_velocities(pixels.size())
+    , d_colours(pixels.size())
+    , d_scorch(pixels.size())
+    , d_updated_ticks(pixels.size())
+    , d_width{width}
+    , d_height{height}
+    , d_circuit{width, height}
+{
+    assert(pixels.size() == width * height);
+    assert(width % config::chunk_size == 0);
+    assert(height % config::chunk_size == 0);
+    const auto width_chunks = width / config::chunk_size;
+    const auto height_chunks = height / config::chunk_size;
+    d_chunks.resize(width_chunks * height_chunks);
+    d_active_pixels.resize(d_chunks.size());
+    d_next_active_pixels.resize(global_thread_pool().size() + 1);
+
+    for (i32 y = 0; y != height; ++y) {
+        for (i32 x = 0; x != width; ++x) {
+            store(index({x, y}), pixels[x + width * y]);
+        }
+    }
 }
 
-auto pixel_world::at(pixel_pos pos) -> pixel&
+auto pixel_world::load(std::size_t i) const -> pixel
 {
-    assert(is_valid_pixel(pos));
-    return d_pixels[pos.x + d_width * pos.y];
+    return pixel{
+        .type         = d_types[i],
+        .colour       = d_colours[i],
+        .scorch       = d_scorch[i],
+        .flags        = d_flags[i],
+        .power        = d_power[i],
+        .updated_tick = d_updated_ticks[i],
+        .velocity     = d_velocities[i]
+    };
+}
+
+auto pixel_world::store(std::size_t i, const pixel& p) -> void
+{
+    if (d_types[i] != p.type && (is_circuit_type(d_types[i]) || is_circuit_type(p.type))) {
+        d_circuit.mark_changed(i / (config::chunk_size * config::chunk_size));
+    }
+    d_types[i]         = p.type;
+    d_colours[i]       = p.colour;
+    d_scorch[i]        = p.scorch;
+    d_flags[i]         = p.flags;
+    d_power[i]         = p.power;
+    d_updated_ticks[i] = p.updated_tick;
+    d_velocities[i]    = p.velocity;
+}
+
+auto pixel_world::pixels() const -> std::vector<pixel>
+{
+    // Saves are row-major, independent of the tiling
+    auto ret = std::vector<pixel>{};
+    ret.reserve(d_types.size());
+    for (i32 y = 0; y != d_height; ++y) {
+        for (i32 x = 0; x != d_width; ++x) {
+            ret.push_back(load(index({x, y})));
+        }
+    }
+    return ret;
 }
 
 auto pixel_world::at(chunk_pos pos) -> chunk&
@@ -522,94 +588,380 @@ auto pixel_world::operator[](chunk_pos pos) const -> const chunk&
 
 auto pixel_world::set(pixel_pos pos, const pixel& p) -> void
 {
-    assert(is_valid_pixel(pos));
-    at(pos) = p;
+    store(index(pos), p);
     wake_chunk_with_pixel(pos);
 }
 
 auto pixel_world::swap(pixel_pos a, pixel_pos b) -> void
 {
-    std::swap(at(a), at(b));
+    const auto i = index(a);
+    const auto j = index(b);
+    if (d_types[i] != d_types[j] && (is_circuit_type(d_types[i]) || is_circuit_type(d_types[j]))) {
+        d_circuit.mark_changed(i / (config::chunk_size * config::chunk_size));
+        d_circuit.mark_changed(j / (config::chunk_size * config::chunk_size));
+    }
+    std::swap(d_types[i], d_types[j]);
+    std::swap(d_colours[i], d_colours[j]);
+    std::swap(d_scorch[i], d_scorch[j]);
+    std::swap(d_flags[i], d_flags[j]);
+    std::swap(d_power[i], d_power[j]);
+    std::swap(d_updated_ticks[i], d_updated_ticks[j]);
+    std::swap(d_velocities[i], d_velocities[j]);
     wake_chunk_with_pixel(a);
     wake_chunk_with_pixel(b);
 }
 
-auto pixel_world::operator[](pixel_pos pos) const -> const pixel&
+auto pixel_world::operator[](pixel_pos pos) const -> pixel
 {
-    assert(is_valid_pixel(pos));
-    return d_pixels[pos.x + d_width * pos.y];
+    return load(index(pos));
 }
 
 auto pixel_world::wake_all() -> void
 {
-    for (auto& c : d_chunks) { c.should_step_next = true; }
+    for (auto& c : d_chunks) {
+        c.should_step_next = true;
+        c.dirty_next = chunk_rect{};
+    }
 }
 
 auto pixel_world::wake_chunk_with_pixel(pixel_pos pos) -> void
 {
-    const auto chunk_pos = get_chunk_from_pixel(pos);
-    wake_chunk(chunk_pos);
+    wake_pixels(glm::ivec2{pos}, glm::ivec2{pos});
+}
+
+auto pixel_world::keep_active(pixel_pos pos) -> void
+{
+    d_next_active_pixels[thread_pool::thread_index()].push_back(pos);
+}
 
-    for (const auto offset : adjacent_offsets) {
-        const auto neighbour_chunk = get_chunk_from_pixel(pos + offset);
-        if (is_valid_chunk(neighbour_chunk)) {
-            wake_chunk(neighbour_chunk);
+auto pixel_world::active_pixels(chunk_pos pos) const -> std::span<const pixel_pos>
+{
+    assert(is_valid_chunk(pos));
+    return d_active_pixels[pos.x + width_in_chunks() * pos.y];
+}
+
+auto pixel_world::wake_pixels(glm::ivec2 min_pixel, glm::ivec2 max_pixel) -> void
+{
+    const auto min = glm::max(min_pixel - wake_margin, glm::ivec2{0, 0});
+    const auto max = glm::min(max_pixel + wake_margin, glm::ivec2{d_width - 1, d_height - 1});
+
+    const auto min_chunk = get_chunk_from_pixel(pixel_pos::from_ivec2(min));
+    const auto max_chunk = get_chunk_from_pixel(pixel_pos::from_ivec2(max));
+    for (i32 cy = min_chunk.y; cy <= max_chunk.y; ++cy) {
+        for (i32 cx = min_chunk.x; cx <= max_chunk.x; ++cx) {
+            const auto top_left = glm::ivec2{get_chunk_top_left({cx, cy})};
+            wake_chunk({cx, cy}, min - top_left, max - top_left);
         }
     }
 }
 
-auto pixel_world::step() -> void
+auto pixel_world::explode(pixel_pos pos, const explosion& info) -> void
 {
-    for (auto& pixel : d_pixels) {
-        pixel.flags[is_updated] = false;
+    const auto lock = std::unique_lock{*d_explosions_mutex};
+    d_explosions.push_back({pos, info});
+}
+
+auto pixel_world::record_blast(const blast& b) -> void
+{
+    d_blasts.push_back(b);
+}
+
+auto pixel_world::take_blasts() -> std::vector<blast>
+{
+    return std::exchange(d_blasts, {});
+}
+
+auto pixel_world::reseed(u64 stream) -> void
+{
+    thread_random_engine().seed(mix_seed(mix_seed(d_seed, d_step_count), stream));
+}
+
+auto pixel_world::step_chunk(chunk_pos pos) -> void
+{
+    reseed(static_cast<u64>(pos.x + width_in_chunks() * pos.y));
+    const auto top_left = get_chunk_top_left(pos);
+    const auto& dirty = at(pos).dirty;
+    for (i32 y = dirty.max.y; y >= dirty.min.y; --y) {
+        if (coin_flip()) {
+            for (i32 x = dirty.min.x; x <= dirty.max.x; ++x) {
+                const auto new_pos = update_pixel(*this, top_left + glm::ivec2{x, y});
+                d_updated_ticks[index(new_pos)] = d_tick;
+            }
+        }
+        else {
+            for (i32 x = dirty.max.x; x >= dirty.min.x; --x) {
+                const auto new_pos = update_pixel(*this, top_left + glm::ivec2{x, y});
+                d_updated_ticks[index(new_pos)] = d_tick;
+            }
+        }
+    }
+    step_active_pixels(pos);
+}
+
+auto pixel_world::step_active_pixels(chunk_pos pos) -> void
+{
+    // Visited like the sweep, from the bottom row up with each row in a random direction,
+    // so power doesn't flow faster one way than the other. Pixels already updated by the
+    // sweep are skipped by update_pixel.
+    const auto& pixels = d_active_pixels[pos.x + width_in_chunks() * pos.y];
+    for (auto first = pixels.begin(); first != pixels.end();) {
+        const auto last = std::find_if(first, pixels.end(), [&](pixel_pos p) { return p.y != first->y; });
+        const auto update = [&](pixel_pos active) {
+            const auto new_pos = update_pixel(*this, active);
+            d_updated_ticks[index(new_pos)] = d_tick;
+        };
+        if (coin_flip()) {
+            std::for_each(first, last, update);
+        } else {
+            std::for_each(std::make_reverse_iterator(last), std::make_reverse_iterator(first), update);
+        }
+        first = last;
+    }
+}
+
+auto pixel_world::gather_active_pixels() -> void
+{
+    for (auto& pixels : d_active_pixels) {
+        pixels.clear();
+    }
+    for (auto& pixels : d_next_active_pixels) {
+        for (const auto pos : pixels) {
+            const auto chunk = get_chunk_from_pixel(pos);
+            d_active_pixels[chunk.x + width_in_chunks() * chunk.y].push_back(pos);
+        }
+        pixels.clear();
+    }
+
+    // A pixel can be added more than once, and the workers reach them in any order
+    for (auto& pixels : d_active_pixels) {
+        if (pixels.size() < 2) continue;
+        std::ranges::sort(pixels, {}, [](pixel_pos p) { return std::pair{-p.y, p.x}; });
+        const auto [first, last] = std::ranges::unique(pixels);
+        pixels.erase(first, last);
     }
+}
+
+auto pixel_world::step_parallel() -> void
+{
+    auto& pool = global_thread_pool();
+    for (const auto phase : checkerboard_phases) {
+        d_phase_chunks.clear();
+        for (i32 cy = height_in_chunks() - 1; cy >= 0; --cy) {
+            for (i32 cx = 0; cx != width_in_chunks(); ++cx) {
+                const auto pos = chunk_pos{cx, cy};
+                const auto has_work = at(pos).should_step || !active_pixels(pos).empty();
+                if (cx % 2 == phase.x && cy % 2 == phase.y && has_work) {
+                    d_phase_chunks.push_back(pos);
+                }
+            }
+        }
+        pool.parallel_for(d_phase_chunks.size(), [&](std::size_t i) {
+            step_chunk(d_phase_chunks[i]);
+        });
+    }
+}
+
+auto pixel_world::resolve_explosions() -> void
+{
+    if (d_explosions.empty()) return;
+
+    // Workers queue explosions in whatever order they get to them
+    std::ranges::sort(d_explosions, {}, [](const queued_explosion& e) {
+        return std::tuple{e.pos.y, e.pos.x, e.info.min_radius, e.info.max_radius, e.info.scorch};
+    });
+    reseed(explosion_stream);
+    apply_explosions(*this, d_explosions);
+    d_explosions.clear();
+}
+
+auto pixel_world::step() -> void
+{
+    // Skip zero so that newly created pixels never look like they've been updated
+    d_tick = (d_tick == std::numeric_limits<u8>::max()) ? 1 : d_tick + 1;
+    ++d_step_count;
+    d_blasts.clear();
 
     for (auto& chunk : d_chunks) {
         chunk.should_step = std::exchange(chunk.should_step_next, false);
+        chunk.dirty = std::exchange(chunk.dirty_next, chunk_rect::empty());
     }
+    gather_active_pixels();
+    d_circuit.update(*this);
 
+    if (d_parallel) {
+        step_parallel();
+    } else {
+        step_serial();
+    }
+    resolve_explosions();
+    d_debris.step(*this);
+
+    // The calling thread's engine has been used by whichever chunks it happened to
+    // step, so reset it before anything else in the tick draws from it
+    reseed(after_step_stream);
+}
+
+auto pixel_world::step_serial() -> void
+{
+    reseed(serial_stream);
     for (i32 y = d_height - 1; y >= 0; --y) {
+        const auto local_y = y % config::chunk_size;
         if (coin_flip()) {
             for (i32 x = 0; x != d_width; x += config::chunk_size) {
                 const auto chunk = at(get_chunk_from_pixel({x, y}));
-                if (chunk.should_step) {
-                    for (i32 dx = 0; dx != config::chunk_size; ++dx) {
+                if (chunk.should_step && chunk.dirty.min.y <= local_y && local_y <= chunk.dirty.max.y) {
+                    for (i32 dx = chunk.dirty.min.x; dx <= chunk.dirty.max.x; ++dx) {
                         const auto new_pos = update_pixel(*this, {x + dx, y});
-                        at(new_pos).flags[is_updated] = true;
+                        d_updated_ticks[index(new_pos)] = d_tick;
                     }
                 }
             }
         }
         else {
-            for (i32 x = d_width - 1; x >= 0; x -= config::chunk_size) {
+            for (i32 x = d_width - config::chunk_size; x >= 0; x -= config::chunk_size) {
                 const auto chunk = at(get_chunk_from_pixel({x, y}));
-                if (chunk.should_step) {
-                    for (i32 dx = 0; dx != config::chunk_size; ++dx) {
-                        const auto new_pos = update_pixel(*this, {x - dx, y});
-                        at(new_pos).flags[is_updated] = true;
+                if (chunk.should_step && chunk.dirty.min.y <= local_y && local_y <= chunk.dirty.max.y) {
+                    for (i32 dx = chunk.dirty.max.x; dx >= chunk.dirty.min.x; --dx) {
+                        const auto new_pos = update_pixel(*this, {x + dx, y});
+                        d_updated_ticks[index(new_pos)] = d_tick;
                     }
                 }
             }
         }
     }
+
+    for (i32 cy = height_in_chunks() - 1; cy >= 0; --cy) {
+        for (i32 cx = 0; cx != width_in_chunks(); ++cx) {
+            step_active_pixels({cx, cy});
+        }
+    }
+}
+
+// Splits the task into at most one piece per worker, with at least min_range items in
+// each, and queues them on the thread pool. Box2D only enqueues and finishes tasks from
+// the thread calling b2World_Step.
+static auto enqueue_physics_task(
+    b2TaskCallback* fn, int item_count, int min_range, void* task_context, void* user_context
+) -> void*
+{
+    auto& pool = global_thread_pool();
+    auto& tasks = *static_cast<physics_tasks*>(user_context);
+
+    // Out of slots, so do the work here. Returning null tells Box2D it is already done.
+    if (tasks.next == tasks.tasks.size()) {
+        fn(0, item_count, static_cast<u32>(thread_pool::thread_index()), task_context);
+        return nullptr;
+    }
+
+    auto& task = tasks.tasks[tasks.next++];
+    ++tasks.in_flight;
+    const auto workers = static_cast<int>(pool.size() + 1);
+    const auto pieces = std::clamp(item_count / std::max(min_range, 1), 1, workers);
+    task.fn = fn;
+    task.context = task_context;
+    task.remaining = pieces;
+
+    for (int i = 0; i != pieces; ++i) {
+        const auto begin = item_count * i / pieces;
+        const auto end = item_count * (i + 1) / pieces;
+        pool.post([&task, begin, end] {
+            task.fn(begin, end, static_cast<u32>(thread_pool::thread_index()), task.context);
+            if (task.remaining.fetch_sub(1) == 1) {
+                task.remaining.notify_all();
+            }
+        });
+    }
+    return &task;
+}
+
+// The stepping thread helps with whatever is queued rather than sitting idle. Box2D's
+// solver tasks wait on each other, so this is also what gives it the one thread more
+// than the pool has that it was promised by the worker count.
+static auto finish_physics_task(void* user_task, void* user_context) -> void
+{
+    auto& pool = global_thread_pool();
+    auto& tasks = *static_cast<physics_tasks*>(user_context);
+    auto& task = *static_cast<physics_task*>(user_task);
+
+    for (auto remaining = task.remaining.load(); remaining != 0; remaining = task.remaining.load()) {
+        if (!pool.run_pending()) {
+            task.remaining.wait(remaining);
+        }
+    }
+
+    if (--tasks.in_flight == 0) {
+        tasks.next = 0;
+    }
 }
 
-static auto make_world(glm::vec2 gravity) -> b2WorldId
+static auto make_world(glm::vec2 gravity, physics_tasks& tasks) -> b2WorldId
 {
     std::print("making world\n");
     auto def = b2DefaultWorldDef();
     def.gravity = {gravity.x, gravity.y};
+
+    // Without workers Box2D is left to run its tasks itself, one after the other
+    const auto& pool = global_thread_pool();
+    if (pool.size() > 0) {
+        def.workerCount = static_cast<int>(pool.size() + 1);
+        def.enqueueTask = enqueue_physics_task;
+        def.finishTask = finish_physics_task;
+        def.userTaskContext = &tasks;
+    }
     return b2CreateWorld(&def);
 }
 
 physics_world::physics_world(glm::vec2 gravity)
-    : world{make_world(gravity)}
+    : tasks{std::make_unique<physics_tasks>()}
+    , world{make_world(gravity, *tasks)}
 {
 }
 
 physics_world::~physics_world()
 {
-    b2DestroyWorld(world);
+    // Workers may still be writing into the jobs
+    for (auto& job : collider_jobs) {
+        job->done.wait(false);
+    }
+    for (auto& job : island_jobs) {
+        job->done.wait(false);
+    }
+    if (b2World_IsValid(world)) {
+        b2DestroyWorld(world);
+    }
+}
+
+physics_world::physics_world(physics_world&& other) noexcept
+    : tasks{std::move(other.tasks)}
+    , world{std::exchange(other.world, b2_nullWorldId)}
+    , chunk_colliders{std::move(other.chunk_colliders)}
+    , collider_jobs{std::move(other.collider_jobs)}
+    , free_collider_jobs{std::move(other.free_collider_jobs)}
+    , merge_sleeping_colliders{other.merge_sleeping_colliders}
+    , island_colliders{std::move(other.island_colliders)}
+    , island_jobs{std::move(other.island_jobs)}
+    , free_island_jobs{std::move(other.free_island_jobs)}
+    , only_colliders_near_bodies{other.only_colliders_near_bodies}
+    , chunks_near_bodies{std::move(other.chunks_near_bodies)}
+    , changed_islands{std::move(other.changed_islands)}
+    , colliders_rebuilt{other.colliders_rebuilt}
+    , colliders_skipped{other.colliders_skipped}
+    , islands_rebuilt{other.islands_rebuilt}
+    , colliders_dropped{other.colliders_dropped}
+{
+    // The jobs are heap allocated, so any still in flight carry on writing into the
+    // same objects, which now belong to this world
+    other.collider_jobs.clear();
+    other.island_jobs.clear();
+}
+
+physics_world& physics_world::operator=(physics_world&& other) noexcept
+{
+    if (this != &other) {
+        std::destroy_at(this);
+        std::construct_at(this, std::move(other));
+    }
+    return *this;
 }
 
 static void begin_contact(level& l, b2ShapeId curr, b2ShapeId other)
@@ -625,7 +977,7 @@ static void begin_contact(level& l, b2ShapeId curr, b2ShapeId other)
     {
         l.entities.mark_for_death(curr_entity);
         const auto pos = ecs_entity_centre(l.entities, curr_entity);
-        apply_explosion(l.pixels, pixel_pos::from_ivec2(pos), explosion{.min_radius=5, .max_radius=10, .scorch=15});   
+        l.pixels.explode(pixel_pos::from_ivec2(pos), explosion{.min_radius=5, .max_radius=10, .scorch=15});
     }
 }
 
@@ -701,8 +1053,15 @@ static void end_sensor_event(level& l, b2ShapeId sensor, b2ShapeId other)
 
 auto level_on_update(level& l, const context& ctx) -> void
 {
+    using clock = std::chrono::steady_clock;
+    const auto seconds_between = [](clock::time_point a, clock::time_point b) {
+        return std::chrono::duration<double>{b - a}.count();
+    };
+
+    const auto start = clock::now();
     l.pixels.step();
 
+    const auto pixels_stepped = clock::now();
     b2World_Step(l.physics.world, sand::config::time_step, 4);
 
     {
@@ -731,23 +1090,14 @@ auto level_on_update(level& l, const context& ctx) -> void
         }
     }
 
-    const auto width_chunks = l.pixels.width_in_chunks();
-    const auto height_chunks = l.pixels.height_in_chunks();
-    for (i32 x = 0; x != width_chunks; ++x) {
-        for (i32 y = 0; y != height_chunks; ++y) {
-            const auto pos = chunk_pos{x, y};
-            if (!l.pixels[pos].should_step) continue;
-            
-            auto& map = l.physics.chunk_bodies;
-            if (auto it = map.find(pos); it != map.end()) {
-                b2DestroyBody(it->second);
-                map.erase(it);
-            }
-            const auto top_left = get_chunk_top_left(pos);
-            map[pos] = create_chunk_rigid_bodies(l, top_left); 
-        }
-    }
+    detach_pixel_clusters(l);
+    settle_pixel_clusters(l);
+
+    const auto physics_stepped = clock::now();
+    update_chunk_colliders(l);
+    enable_pixel_clusters(l);
 
+    const auto colliders_rebuilt = clock::now();
     for (auto e : l.entities.view<player_component>()) {
         update_player(l.entities, e, ctx.input);
     }
@@ -766,7 +1116,14 @@ auto level_on_update(level& l, const context& ctx) -> void
         }
     }
     l.entities.destroy_marked();
-    
+
+    const auto end = clock::now();
+    l.timings = {
+        .pixel_step       = seconds_between(start, pixels_stepped),
+        .physics_step     = seconds_between(pixels_stepped, physics_stepped),
+        .collider_rebuild = seconds_between(physics_stepped, colliders_rebuilt),
+        .entity_update    = seconds_between(colliders_rebuilt, end)
+    };
 }
 
 auto level_on_event(level& l, const context& ctx, const event& ev) -> void
@@ -5,10 +5,19 @@
 #include "world_save.hpp"
 #include "entity.hpp"
 #include "context.hpp"
+#include "explosion.hpp"
+#include "debris.hpp"
+#include "circuit.hpp"
+#include "random.hpp"
+#include "update_rigid_bodies.hpp"
 
 #include <cstdint>
+#include <span>
 #include <unordered_set>
 #include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
 
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/glm.hpp>
@@ -19,57 +28,172 @@ namespace sand {
 
 auto get_chunk_top_left(chunk_pos pos) -> pixel_pos;
 
+// An inclusive range of pixels within a chunk, in chunk-local coordinates
+struct chunk_rect
+{
+    glm::ivec2 min = {0, 0};
+    glm::ivec2 max = {config::chunk_size - 1, config::chunk_size - 1};
+
+    static constexpr auto empty() -> chunk_rect
+    {
+        return {{config::chunk_size, config::chunk_size}, {-1, -1}};
+    }
+};
+
 struct chunk
 {
-    bool    should_step      = true;
-    bool    should_step_next = true;
+    bool       should_step      = true;
+    bool       should_step_next = true;
+
+    // Only the pixels in dirty are stepped, and dirty_next grows as pixels in the
+    // chunk are touched during the current tick.
+    chunk_rect dirty            = {};
+    chunk_rect dirty_next       = {};
 };
 
 class pixel_world
 {
-    std::vector<pixel> d_pixels;
+    // Pixels are stored as a structure of arrays with one plane per field, so scans
+    // that only care about, say, the type of a pixel don't drag the rest of the pixel
+    // into cache. Whole pixels are gathered and scattered by operator[] and visit.
+    // Each plane is tiled so that every chunk is contiguous, see index.
+    std::vector<pixel_type>     d_types;
+    std::vector<pixel_flag_set> d_flags;
+    std::vector<u8>             d_power;
+    std::vector<glm::i8vec2>    d_velocities;
+    std::vector<u8>             d_colours;
+    std::vector<u8>             d_scorch;
+    std::vector<u8>             d_updated_ticks;
+
     std::vector<chunk> d_chunks;
     i32                d_width;
     i32                d_height;
+
+    // Pixels store the tick they were last updated on rather than a flag, so nothing
+    // needs clearing between steps. A pixel left alone for an exact multiple of 255
+    // ticks can be skipped for one update, which is harmless as it was asleep.
+    u8                 d_tick = 1;
+
+    // Every random number drawn while stepping comes from a stream derived from the
+    // seed and the step count. In parallel each chunk also gets its own stream, so two
+    // worlds with the same pixels and seed stay identical however the chunks are spread
+    // over threads. Serial stepping walks the rows with a single stream instead, so it
+    // is deterministic too but does not match the parallel results.
+    u64                d_seed = random_seed();
+    u64                d_step_count = 0;
+
+    // When stepping in parallel, chunks are split into a 2x2 checkerboard and every
+    // chunk in a phase is stepped at the same time. Explosions reach too far to be
+    // applied from a worker, so in either mode they are queued and applied together
+    // once the step is done.
+    bool                          d_parallel = true;
+    std::vector<chunk_pos>        d_phase_chunks;
+    std::vector<queued_explosion> d_explosions;
+    std::unique_ptr<std::mutex>   d_explosions_mutex = std::make_unique<std::mutex>();
+
+    // Explosions applied since the start of the last step, so that the pixels they cut
+    // loose can be found, see pixel_cluster.hpp. Cleared each step, so drivers that never
+    // call take_blasts don't keep them forever.
+    std::vector<blast> d_blasts;
+
+    // Pixels thrown out by explosions that haven't landed yet
+    debris d_debris;
+
+    // The nets of conductors that carry power, see circuit.hpp
+    circuit d_circuit;
+
+    // Pixels that need updating whether or not their chunk is awake, such as batteries
+    // and embers, see keep_active. Workers gather them into their own list, indexed by
+    // thread_pool::thread_index, and at the start of the next step they are sorted into
+    // a list per chunk, laid out like d_chunks.
+    std::vector<std::vector<pixel_pos>> d_active_pixels;
+    std::vector<std::vector<pixel_pos>> d_next_active_pixels;
     
-    auto at(pixel_pos pos) -> pixel&;
     auto at(chunk_pos pos) -> chunk&;
 
-    auto wake_chunk(chunk_pos pos) -> void;
-    
-public:
-    pixel_world(i32 width, i32 height, const std::vector<pixel>& pixels)
-        : d_pixels{pixels}
-        , d_width{width}
-        , d_height{height}
+    // Chunks are laid out row by row, and the pixels within each chunk are also laid
+    // out row by row, so stepping a chunk walks a single block of memory.
+    inline auto index(pixel_pos pos) const -> std::size_t
     {
-        assert(pixels.size() == width * height);
-        assert(width % config::chunk_size == 0);
-        assert(height % config::chunk_size == 0);
-        const auto width_chunks = width / config::chunk_size;
-        const auto height_chunks = height / config::chunk_size;
-        d_chunks.resize(width_chunks * height_chunks);
+        assert(is_valid_pixel(pos));
+        constexpr auto size = static_cast<u32>(config::chunk_size);
+        const auto x = static_cast<u32>(pos.x);
+        const auto y = static_cast<u32>(pos.y);
+        const auto chunk = (x / size) + static_cast<u32>(width_in_chunks()) * (y / size);
+        return std::size_t{chunk} * size * size + (x % size) + size * (y % size);
     }
+
+    auto load(std::size_t i) const -> pixel;
+    auto store(std::size_t i, const pixel& p) -> void;
+
+    auto wake_chunk(chunk_pos pos, glm::ivec2 min, glm::ivec2 max) -> void;
+    auto step_chunk(chunk_pos pos) -> void;
+    auto step_serial() -> void;
+    auto step_parallel() -> void;
+    auto resolve_explosions() -> void;
+    auto gather_active_pixels() -> void;
+    auto step_active_pixels(chunk_pos pos) -> void;
+    auto reseed(u64 stream) -> void;
+    
+public:
+    pixel_world(i32 width, i32 height, const std::vector<pixel>& pixels);
     pixel_world(i32 width, i32 height)
         : pixel_world(width, height, std::vector<sand::pixel>(width * height, sand::pixel::air()))
     {}
     
     auto step() -> void;
 
+    // Explosions triggered by the simulation go through here. They are queued and go
+    // off together at the end of the next step, see apply_explosions.
+    auto explode(pixel_pos pos, const explosion& info) -> void;
+
+    auto record_blast(const blast& b) -> void;
+    auto take_blasts() -> std::vector<blast>;
+
+    inline auto flying_debris() -> debris& { return d_debris; }
+    inline auto flying_debris() const -> const debris& { return d_debris; }
+
     auto wake_chunk_with_pixel(pixel_pos pixel) -> void;
+
+    // Has the pixel updated next step even if its chunk sleeps, without waking the chunk
+    auto keep_active(pixel_pos pos) -> void;
+    auto active_pixels(chunk_pos pos) const -> std::span<const pixel_pos>;
+
+    // As wake_chunk_with_pixel for every pixel in the inclusive box, but waking each
+    // chunk only once
+    auto wake_pixels(glm::ivec2 min, glm::ivec2 max) -> void;
     auto wake_all() -> void;
     
     auto is_valid_pixel(pixel_pos pos) const -> bool;
     auto is_valid_chunk(chunk_pos pos) const -> bool;
     auto set(pixel_pos pos, const pixel& p) -> void;
     auto swap(pixel_pos a, pixel_pos b) -> void;
-    auto operator[](pixel_pos pos) const -> const pixel&;
+    auto operator[](pixel_pos pos) const -> pixel;
     auto operator[](chunk_pos pos) const -> const chunk&;
+
+    // Reads a single field without gathering the whole pixel
+    inline auto type(pixel_pos pos) const -> pixel_type { return d_types[index(pos)]; }
+    inline auto flags(pixel_pos pos) const -> pixel_flag_set { return d_flags[index(pos)]; }
+    inline auto power(pixel_pos pos) const -> u8 { return d_power[index(pos)]; }
+    inline auto velocity(pixel_pos pos) const -> glm::i8vec2 { return d_velocities[index(pos)]; }
+    inline auto updated_tick(pixel_pos pos) const -> u8 { return d_updated_ticks[index(pos)]; }
+
+    // The type and flag planes of a whole chunk, row by row
+    inline auto chunk_types(chunk_pos pos) const -> std::span<const pixel_type>
+    {
+        return std::span{d_types}.subspan(index(get_chunk_top_left(pos)), config::chunk_size * config::chunk_size);
+    }
+    inline auto chunk_flags(chunk_pos pos) const -> std::span<const pixel_flag_set>
+    {
+        return std::span{d_flags}.subspan(index(get_chunk_top_left(pos)), config::chunk_size * config::chunk_size);
+    }
     
     auto visit_no_wake(pixel_pos pos, auto&& updater) -> void
     {
-        assert(is_valid_pixel(pos));
-        updater(at(pos));
+        const auto i = index(pos);
+        auto p = load(i);
+        updater(p);
+        store(i, p);
     }
     
     auto visit(pixel_pos pos, auto&& updater) -> void
@@ -83,14 +207,106 @@ public:
     inline auto width_in_chunks() const -> i32 { return d_width / config::chunk_size; }
     inline auto height_in_chunks() const -> i32 { return d_height / config::chunk_size; }
 
+    inline auto tick() const -> u8 { return d_tick; }
+
+    inline auto seed() const -> u64 { return d_seed; }
+    inline auto set_seed(u64 seed) -> void { d_seed = seed; }
+
+    inline auto is_parallel() const -> bool { return d_parallel; }
+    inline auto set_parallel(bool parallel) -> void { d_parallel = parallel; }
+
     // Exposed for serialisation
-    auto pixels() const -> const std::vector<pixel>& { return d_pixels; }
+    auto pixels() const -> std::vector<pixel>;
+};
+
+// The static body of a chunk. The body outlives its chains, which are swapped out when
+// the chunk is retraced, so a rebuild doesn't cost Box2D a body and broadphase proxy.
+struct chunk_collider
+{
+    b2BodyId               body = b2_nullBodyId;
+    std::vector<b2ChainId> chains;
+    chunk_static_pixels    mask; // The static pixels the latest chains were requested for
+    bool                   active = false; // Whether a collider has been requested at all
+    i32                    sleeping_updates = 0;
+    bool                   merged = false; // Whether the pixels are part of the island's body instead
+};
+
+struct island_collider
+{
+    b2BodyId               body = b2_nullBodyId;
+    std::vector<b2ChainId> chains;
+};
+
+// Colliders are traced on the thread pool, see update_rigid_bodies.hpp. The job is
+// heap allocated so that its address stays put while a worker fills in the chains,
+// and reused once applied.
+struct collider_job
+{
+    chunk_pos           pos;
+    chunk_static_pixels mask;
+    pixel_pos           top_left;
+    collider_chains     chains;
+    std::atomic<bool>   done = false;
+};
+
+// Traces the merged collider of an island, see update_rigid_bodies.hpp
+struct island_job
+{
+    island_pos                                              pos;
+    std::vector<std::pair<chunk_pos, chunk_static_pixels>> chunks;
+    collider_chains                                         chains;
+    std::atomic<bool>                                       done = false;
+};
+
+// A range of a task Box2D handed to the thread pool, see make_world in world.cpp
+struct physics_task
+{
+    b2TaskCallback*  fn = nullptr;
+    void*            context = nullptr;
+    std::atomic<i32> remaining = 0; // Pieces still to run
+};
+
+// The tasks Box2D has in flight during a step. They are finished before the step
+// returns, so the slots are reused from the start once none are left.
+struct physics_tasks
+{
+    std::array<physics_task, 128> tasks;
+    std::size_t                   next = 0;
+    std::size_t                   in_flight = 0;
 };
 
 struct physics_world
 {
+    // Heap allocated as Box2D holds on to its address, which must survive a move
+    std::unique_ptr<physics_tasks> tasks;
     b2WorldId world;
-    std::unordered_map<chunk_pos, b2BodyId> chunk_bodies;
+
+    // Indexed by y * width_in_chunks + x, and sized on the first update
+    std::vector<chunk_collider>                chunk_colliders;
+    std::vector<std::unique_ptr<collider_job>> collider_jobs;
+    std::vector<std::unique_ptr<collider_job>> free_collider_jobs;
+
+    // When set, chunks that have been asleep for a while give up their own bodies and
+    // are traced together with the other sleeping chunks of their island instead
+    bool merge_sleeping_colliders = false;
+    std::vector<island_collider>             island_colliders; // Laid out like chunk_colliders
+    std::vector<std::unique_ptr<island_job>> island_jobs;
+    std::vector<std::unique_ptr<island_job>> free_island_jobs;
+
+    // When set, only chunks near a dynamic body have colliders at all. The rest drop
+    // theirs and have them traced again when something comes close.
+    bool only_colliders_near_bodies = false;
+
+    // Scratch space for update_chunk_colliders, kept so it doesn't allocate every update
+    std::vector<bool>       chunks_near_bodies;
+    std::vector<island_pos> changed_islands;
+
+    // Awake chunks whose static pixels changed, and so had their colliders rebuilt, and
+    // those that were left alone, during the last update
+    i32 colliders_rebuilt = 0;
+    i32 colliders_skipped = 0;
+    i32 islands_rebuilt = 0;
+    i32 colliders_dropped = 0;
 
     physics_world(glm::vec2 gravity = config::gravity);
     ~physics_world();
@@ -98,18 +314,31 @@ struct physics_world
     physics_world(const physics_world&) = delete;
     physics_world& operator=(const physics_world&) = delete;
 
-    physics_world(physics_world&&) = default;
-    physics_world& operator=(physics_world&&) = default;
+    // Moved from worlds are left with no Box2D world. Assigning over a world first waits
+    // for its outstanding collider jobs, as workers may still be writing into them.
+    physics_world(physics_world&& other) noexcept;
+    physics_world& operator=(physics_world&& other) noexcept;
+};
+
+// Wall clock time spent in each part of the most recent level_on_update, in seconds
+struct update_timings
+{
+    double pixel_step       = 0.0;
+    double physics_step     = 0.0; // Includes contact and sensor events, and pixel clusters
+    double collider_rebuild = 0.0;
+    double entity_update    = 0.0;
 };
 
 struct level
 {
-    pixel_world   pixels;
-    physics_world physics;
-    registry      entities;
+    pixel_world    pixels;
+    physics_world  physics;
+    registry       entities;
+
+    pixel_pos      spawn_point;
+    entity         player;
 
-    pixel_pos     spawn_point;
-    entity        player;
+    update_timings timings = {};
 };
 
 auto level_on_update(level& l, const context& ctx) -> void;
@@ -1,11 +1,16 @@
 #pragma once
 #include "serialise.hpp"
 #include "pixel.hpp"
+#include "common.hpp"
 
 #include <cstddef>
 
 namespace sand {
 
+// Written at the start of every save file. Saves from before pixels were packed
+// don't have it, and get converted when they are loaded.
+static constexpr u64 world_save_magic = 0x3230'4C46'444E'4153; // "SANDFL02"
+
 struct world_save
 {
     std::vector<pixel> pixels;
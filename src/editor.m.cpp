@@ -202,6 +202,9 @@ auto main() -> int
             ImGui::Text("FPS: %d", timer.frame_rate());
             ImGui::Text("Awake chunks: %d", num_awake_chunks(level.pixels));
             ImGui::Checkbox("Show chunks", &editor.show_chunks);
+            if (bool parallel = level.pixels.is_parallel(); ImGui::Checkbox("Parallel step", &parallel)) {
+                level.pixels.set_parallel(parallel);
+            }
             if (ImGui::Button("Clear")) {
                 clear_world(level.pixels);
             }
@@ -277,6 +280,11 @@ auto main() -> int
             b2World_Draw(level.physics.world, &debug);
         }
 
+        const auto& debris = level.pixels.flying_debris();
+        for (std::size_t i = 0; i != debris.size(); ++i) {
+            shape_renderer.draw_quad(debris.positions()[i], 1.0f, 1.0f, 0.0f, pixel_colour(debris.pixels()[i]));
+        }
+
         if (editor.show_spawn) {
             const auto p = glm::ivec2{level.spawn_point.x, level.spawn_point.y};
             shape_renderer.draw_circle(p, {0, 1, 0, 1}, 1.0);
@@ -290,6 +298,8 @@ auto main() -> int
                     const auto chunk = level.pixels[cpos];
                     if (chunk.should_step) {
                         shape_renderer.draw_rect(glm::ivec2{top_left}, config::chunk_size, config::chunk_size, {1, 1, 1, 0.1});
+                        const auto size = chunk.dirty.max - chunk.dirty.min + 1;
+                        shape_renderer.draw_rect(glm::ivec2{top_left} + chunk.dirty.min, size.x, size.y, {1, 0, 0, 0.2});
                     }
                 }
             }
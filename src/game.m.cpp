@@ -9,6 +9,7 @@
 #include "debug.hpp"
 #include "shape_renderer.hpp"
 #include "ui.hpp"
+#include "pixel_cluster.hpp"
 
 #include <glm/glm.hpp>
 #include <glm/gtx/norm.hpp>
@@ -93,6 +94,8 @@ auto scene_level(sand::window& window) -> next_state
     auto shape_renderer  = sand::shape_renderer{};
     auto ui              = sand::ui_engine{};
     
+    level.physics.merge_sleeping_colliders = true;
+    level.physics.only_colliders_near_bodies = true;
     level.player = add_player(level.entities, level.physics.world, level.spawn_point);
     const auto enemy_pos = glm::ivec2{ecs_entity_centre(level.entities, level.player) + glm::vec2{200, 0}};
     add_enemy(level.entities, level.physics.world, pixel_pos::from_ivec2(enemy_pos));
@@ -174,6 +177,16 @@ auto scene_level(sand::window& window) -> next_state
         for (auto e : level.entities.view<body_component>()) {
             shape_renderer.draw_circle(ecs_entity_centre(level.entities, e), {0.5, 1.0, 0.5, 1.0}, 2.5);
         }
+        for (auto e : level.entities.view<pixel_cluster_component>()) {
+            const auto angle = b2Rot_GetAngle(b2Body_GetRotation(level.entities.get<body_component>(e).body));
+            for_each_cluster_pixel(level.entities, e, [&](glm::vec2 centre, const pixel& p) {
+                shape_renderer.draw_quad(centre, 1.0f, 1.0f, angle, pixel_colour(p));
+            });
+        }
+        const auto& debris = level.pixels.flying_debris();
+        for (std::size_t i = 0; i != debris.size(); ++i) {
+            shape_renderer.draw_quad(debris.positions()[i], 1.0f, 1.0f, 0.0f, pixel_colour(debris.pixels()[i]));
+        }
 
         const auto centre = ecs_entity_centre(level.entities, level.player);
         const auto direction = glm::normalize(mouse_pos_world_space(ctx.input, ctx.camera) - centre);